@@ -29,6 +29,16 @@ static Node* get_node(fe_Context *ctx, int id) {
 }
 
 
+static int get_node_list(fe_Context *ctx, fe_Object *lst, Node **nodes, int max) {
+  int n = 0;
+  while (!fe_isnil(ctx, lst)) {
+    if (n == max) { fe_error(ctx, "too many nodes"); }
+    nodes[n++] = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &lst)));
+  }
+  return n;
+}
+
+
 static fe_Object* f_set_tick(fe_Context *ctx, fe_Object *arg) {
   float n = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
   if (n <= 0.0) { fe_error(ctx, "expected time greater than 0"); }
@@ -37,6 +47,14 @@ static fe_Object* f_set_tick(fe_Context *ctx, fe_Object *arg) {
 }
 
 
+static fe_Object* f_set_threads(fe_Context *ctx, fe_Object *arg) {
+  int n = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  if (n < 1) { fe_error(ctx, "expected thread count of at least 1"); }
+  dsp_set_threads(n);
+  return fe_bool(ctx, false);
+}
+
+
 static fe_Object* f_set_stream(fe_Context *ctx, fe_Object *arg) {
   char str[256];
   char *filename;
@@ -45,13 +63,23 @@ static fe_Object* f_set_stream(fe_Context *ctx, fe_Object *arg) {
     filename = str;
   } else {
     filename = NULL;
+    fe_nextarg(ctx, &arg);
   }
-  int err = dsp_set_stream(filename);
+  int bits = fe_isnil(ctx, arg) ? 24 : fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  if (bits != 16 && bits != 24 && bits != 32) {
+    fe_error(ctx, "expected bit depth of 16, 24 or 32");
+  }
+  int err = dsp_set_stream(filename, bits);
   if (err) { fe_error(ctx, "failed to open stream"); }
   return fe_bool(ctx, false);
 }
 
 
+static fe_Object* f_stream_overruns(fe_Context *ctx, fe_Object *arg) {
+  return fe_number(ctx, dsp_get_stream_overruns());
+}
+
+
 static fe_Object* f_new(fe_Context *ctx, fe_Object *arg) {
   char name[128];
   fe_tostring(ctx, fe_nextarg(ctx, &arg), name, sizeof(name));
@@ -76,7 +104,7 @@ static fe_Object* f_link(fe_Context *ctx, fe_Object *arg) {
   Node *node2 = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &arg)));
   fe_tostring(ctx, fe_nextarg(ctx, &arg), inlet, sizeof(inlet));
 
-  check_node_error(ctx, node_link(node1, outlet, node2, inlet));
+  check_node_error(ctx, dsp_link(node1, outlet, node2, inlet));
   return fe_bool(ctx, false);
 }
 
@@ -88,7 +116,7 @@ static fe_Object* f_unlink(fe_Context *ctx, fe_Object *arg) {
   Node *node2 = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &arg)));
   fe_tostring(ctx, fe_nextarg(ctx, &arg), inlet, sizeof(inlet));
 
-  check_node_error(ctx, node_link(node1, outlet, node2, inlet));
+  check_node_error(ctx, dsp_unlink(node1, outlet, node2, inlet));
   return fe_bool(ctx, false);
 }
 
@@ -99,7 +127,35 @@ static fe_Object* f_set(fe_Context *ctx, fe_Object *arg) {
   fe_tostring(ctx, fe_nextarg(ctx, &arg), inlet, sizeof(inlet));
   float value = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
 
-  check_node_error(ctx, node_set(node, inlet, value));
+  check_node_error(ctx, dsp_set(node, inlet, value));
+  return fe_bool(ctx, false);
+}
+
+
+static fe_Object* f_set_at(fe_Context *ctx, fe_Object *arg) {
+  char inlet[64];
+  Node *node = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &arg)));
+  fe_tostring(ctx, fe_nextarg(ctx, &arg), inlet, sizeof(inlet));
+  float value = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  float time = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+
+  check_node_error(ctx, dsp_set_at(node, inlet, value, time));
+  return fe_bool(ctx, false);
+}
+
+
+static fe_Object* f_smooth(fe_Context *ctx, fe_Object *arg) {
+  /* keep in sync with `node.h` smoothing enums */
+  static const char *mode_strings[] = { "off", "linear", "onepole", NULL };
+  char inlet[64], mode[16];
+  Node *node = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &arg)));
+  fe_tostring(ctx, fe_nextarg(ctx, &arg), inlet, sizeof(inlet));
+  fe_tostring(ctx, fe_nextarg(ctx, &arg), mode, sizeof(mode));
+  int idx = string_to_enum(mode_strings, mode);
+  if (idx < 0) { fe_error(ctx, "bad smoothing mode"); }
+  float time = fe_isnil(ctx, arg) ? 0.05 : fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+
+  check_node_error(ctx, dsp_smooth(node, inlet, idx, time));
   return fe_bool(ctx, false);
 }
 
@@ -116,24 +172,63 @@ static fe_Object* f_get(fe_Context *ctx, fe_Object *arg) {
 
 static fe_Object* f_send(fe_Context *ctx, fe_Object *arg) {
   char str[1024];
-  char err_buf[NODE_MAX_ERROR];
   Node *node = get_node(ctx, fe_tonumber(ctx, fe_nextarg(ctx, &arg)));
   fe_tostring(ctx, fe_nextarg(ctx, &arg), str, sizeof(str));
-  int err = node->vtable->receive(node, str, err_buf);
-  if (err) { fe_error(ctx, err_buf); }
+  dsp_send(node, str);
   return fe_bool(ctx, false);
 }
 
 
+static fe_Object* f_voices(fe_Context *ctx, fe_Object *arg) {
+  return fe_number(ctx, dsp_new_voice_pool());
+}
+
+
+static fe_Object* f_add_voice(fe_Context *ctx, fe_Object *arg) {
+  Node *nodes[1024], *envs[DSP_MAX_VOICE_ENVS];
+  int pool = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  int count = get_node_list(ctx, fe_nextarg(ctx, &arg), nodes, 1024);
+  int env_count = get_node_list(ctx, fe_nextarg(ctx, &arg), envs, DSP_MAX_VOICE_ENVS);
+  int idx = dsp_add_voice(pool, nodes, count, envs, env_count);
+  if (idx < 0) { fe_error(ctx, "bad voice pool"); }
+  return fe_number(ctx, idx);
+}
+
+
+static fe_Object* f_note_on(fe_Context *ctx, fe_Object *arg) {
+  int pool = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  int note = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  int idx = dsp_note_on(pool, note);
+  if (idx < 0) { fe_error(ctx, "bad voice pool"); }
+  return fe_number(ctx, idx);
+}
+
+
+static fe_Object* f_note_off(fe_Context *ctx, fe_Object *arg) {
+  int pool = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  int note = fe_tonumber(ctx, fe_nextarg(ctx, &arg));
+  int idx = dsp_note_off(pool, note);
+  return idx < 0 ? fe_bool(ctx, false) : fe_number(ctx, idx);
+}
+
+
 fex_Reg api_dsp[] = {
-  { "dsp:set-tick",   f_set_tick   },
-  { "dsp:set-stream", f_set_stream },
-  { "dsp:new",        f_new        },
-  { "dsp:destroy",    f_destroy    },
-  { "dsp:link",       f_link       },
-  { "dsp:unlink",     f_unlink     },
-  { "dsp:set",        f_set        },
-  { "dsp:get",        f_get        },
-  { "dsp:send",       f_send       },
+  { "dsp:set-tick",        f_set_tick        },
+  { "dsp:set-threads",     f_set_threads     },
+  { "dsp:set-stream",      f_set_stream      },
+  { "dsp:stream-overruns", f_stream_overruns },
+  { "dsp:new",             f_new             },
+  { "dsp:destroy",         f_destroy         },
+  { "dsp:link",            f_link            },
+  { "dsp:unlink",          f_unlink          },
+  { "dsp:set",             f_set             },
+  { "dsp:set-at",          f_set_at          },
+  { "dsp:smooth",          f_smooth          },
+  { "dsp:get",             f_get             },
+  { "dsp:send",            f_send            },
+  { "dsp:voices",          f_voices          },
+  { "dsp:add-voice",       f_add_voice       },
+  { "dsp:note-on",         f_note_on         },
+  { "dsp:note-off",        f_note_off        },
   {},
 };
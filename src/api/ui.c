@@ -190,7 +190,7 @@ static fe_Object* f_scope(fe_Context *ctx, fe_Object *arg) {
 
   float *buf = node->outlets[idx].buf;
   for (int i = 0; i < r.w; i++) {
-    float p = i * (NODE_BUFFER_SIZE - 1) / (float) r.w;
+    float p = i * (node_ctx.buffer_size - 1) / (float) r.w;
     int n = p;
     float val = lerpf(buf[n], buf[n + 1], p - n);
     int h = clampf(fabs(val * r.h / 2), 1, r.h / 2);
@@ -9,8 +9,11 @@ App app;
 
 
 static void tick_callback(void) {
+  /* called on the audio thread; the script lock is shared with on-frame, so
+  ** audio waits on any frame in progress */
   app_fe_push();
   app_do_string("(if on-tick (on-tick))");
+  dsp_end_tick();
   app_fe_pop();
 }
 
@@ -36,15 +39,67 @@ static void midi_callback(MidiMessage msg) {
 static mu_Container console_win;
 
 
-void app_init(int argc, char **argv) {
-  if (argc > 1) { expect( chdir(argv[1]) == 0 ); }
+static int parse_int(const char *str, int min, int max, const char *err) {
+  char *end;
+  long n = strtol(str, &end, 10);
+  if (end == str || *end || n < min || n > max) { panic(err); }
+  return n;
+}
 
-  SDL_Init(SDL_INIT_EVERYTHING);
-#if _WIN32
-  SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
-#endif
-  app.fe_lock = SDL_CreateMutex();
 
+static void parse_args(int argc, char **argv) {
+  char *dir = NULL;
+  app.samplerate = 44100;
+  app.block_size = 64;
+  app.device.period = 1024;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+      /* resolve the output path now as we change directory after */
+      char *filename = argv[++i], cwd[1024];
+      if (!filename[0]) { panic("expected a render output file"); }
+      bool absolute = filename[0] == '/' || filename[0] == '\\' || filename[1] == ':';
+      int len;
+      if (absolute) {
+        len = snprintf(app.render.filename, sizeof(app.render.filename), "%s", filename);
+      } else {
+        expect( getcwd(cwd, sizeof(cwd)) );
+        len = snprintf(app.render.filename, sizeof(app.render.filename), "%s/%s", cwd, filename);
+      }
+      if (len >= sizeof(app.render.filename)) { panic("render output path is too long"); }
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      app.render.seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--samplerate") == 0 && i + 1 < argc) {
+      app.samplerate = parse_int(argv[++i], 1, 768000,
+        "expected a samplerate between 1 and 768000");
+    } else if (strcmp(argv[i], "--block-size") == 0 && i + 1 < argc) {
+      app.block_size = parse_int(argv[++i], 1, NODE_MAX_BUFFER_SIZE,
+        "expected a block size between 1 and 256");
+    } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      app.device.name = argv[++i];
+    } else if (strcmp(argv[i], "--period") == 0 && i + 1 < argc) {
+      /* SDL takes a 16-bit power-of-two period */
+      app.device.period = parse_int(argv[++i], 1, 32768,
+        "expected a period between 1 and 32768");
+    } else if (strcmp(argv[i], "--input-device") == 0 && i + 1 < argc) {
+      app.input.name = argv[++i];
+      app.input.open = true;
+    } else if (strcmp(argv[i], "--input") == 0) {
+      app.input.open = true;
+    } else if (strcmp(argv[i], "--list-devices") == 0) {
+      app.device.list = true;
+    } else {
+      dir = argv[i];
+    }
+  }
+  /* checked once all arguments are read as they can come in any order */
+  if (app.device.period < app.block_size) {
+    panic("expected a period no smaller than the block size");
+  }
+  if (dir) { expect( chdir(dir) == 0 ); }
+}
+
+
+static void init_ui(void) {
   /* init ui */
   app.mu_ctx = ui_init(APP_TITLE);
   app.mu_ctx->style->title_height = 22;
@@ -69,6 +124,60 @@ void app_init(int argc, char **argv) {
   console_win.rect = mu_rect(300, 40, 400, 230);
   console_win.zindex = 0xffffff;
   console_win.open = false;
+}
+
+
+static void open_device(void) {
+  char buf[256];
+
+  /* the input has to be opened first, see `dsp_open_input()` */
+  if (app.input.open) {
+    const char *name = app.input.name;
+    if (dsp_open_input(name, app.device.period)) {
+      sprintf(buf, "error: failed to open audio input '%.128s'", name ? name : "default");
+      app_log_error(buf);
+    }
+  }
+
+  const char *name = app.device.name;
+  if (name && dsp_open_device(name, app.device.period)) {
+    sprintf(buf, "error: failed to open audio device '%.128s', using default", name);
+    app_log_error(buf);
+    name = NULL;
+  }
+  if (!name && dsp_open_device(NULL, app.device.period)) {
+    panic("failed to open audio device");
+  }
+  sprintf(buf, "audio device: %.128s, period: %d", name ? name : "default", dsp_get_period());
+  app_log(buf);
+}
+
+
+void app_init(int argc, char **argv) {
+  parse_args(argc, argv);
+
+  /* when rendering offline we run without a window, audio device or midi */
+  bool headless = app.render.filename[0];
+
+  SDL_Init(headless ? 0 : SDL_INIT_EVERYTHING);
+#if _WIN32
+  SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
+#endif
+  app.fe_lock = SDL_CreateMutex();
+
+  if (app.device.list) {
+    printf("output devices:\n");
+    for (int i = 0; i < SDL_GetNumAudioDevices(0); i++) {
+      printf("  %s\n", SDL_GetAudioDeviceName(i, 0));
+    }
+    printf("input devices:\n");
+    for (int i = 0; i < SDL_GetNumAudioDevices(1); i++) {
+      printf("  %s\n", SDL_GetAudioDeviceName(i, 1));
+    }
+    exit(EXIT_SUCCESS);
+  }
+
+  if (!headless) { init_ui(); }
 
   /* init `fe` */
   int bytes = 1024 * 256;
@@ -79,8 +188,11 @@ void app_init(int argc, char **argv) {
   extern fex_Reg api_dsp  []; fex_register_funcs(app.fe_ctx, api_dsp  );
 
   /* init dsp and midi */
-  dsp_init(tick_callback);
-  midi_init(midi_callback);
+  dsp_init(tick_callback, app.samplerate, app.block_size);
+  if (!headless) {
+    open_device();
+    midi_init(midi_callback);
+  }
 
   /* init scripts */
   app_fe_push();
@@ -140,10 +252,21 @@ static void console_window(mu_Context *ctx) {
 }
 
 
+static void log_dsp_error(const char *err) {
+  char buf[NODE_MAX_ERROR + 16];
+  sprintf(buf, "error: %s", err);
+  app_log_error(buf);
+}
+
+
 static void process_frame(mu_Context *ctx) {
   static mu_Container win;
   const int opt = MU_OPT_NOTITLE | MU_OPT_NOFRAME | MU_OPT_AUTOSIZE;
 
+  /* log errors from node messages handled on the audio thread */
+  char err[NODE_MAX_ERROR];
+  while (dsp_poll_error(err)) { log_dsp_error(err); }
+
   if (mu_begin_window_ex(app.mu_ctx, &win, "Main", opt)) {
     app_fe_push();
     app_do_string("(if on-frame (on-frame))");
@@ -175,6 +298,15 @@ static void process_frame(mu_Context *ctx) {
 
 
 void app_run(void) {
+  /* offline render */
+  if (app.render.filename[0]) {
+    double seconds = app.render.seconds > 0 ? app.render.seconds : 10;
+    if (dsp_render(app.render.filename, seconds, log_dsp_error)) {
+      panic("failed to open render output file");
+    }
+    return;
+  }
+
   /* main loop */
   for (;;) {
     ui_begin_frame(app.mu_ctx);
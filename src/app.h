@@ -14,6 +14,10 @@ typedef struct {
   fe_Context *fe_ctx;
   SDL_mutex *fe_lock;
   struct { char buf[4096]; int idx; bool updated; } log;
+  struct { char filename[1024]; double seconds; } render;
+  int samplerate, block_size;
+  struct { char *name; int period; bool list; } device;
+  struct { char *name; bool open; } input;
 } App;
 
 extern App app;
@@ -16,6 +16,14 @@ static inline float minf(float a, float b) { return a < b ? a : b; }
 static inline float maxf(float a, float b) { return a > b ? a : b; }
 static inline float lerpf(float a, float b, float p) { return a + (b - a) * p; }
 
+static inline float random_float(uint32_t *seed) {
+  /* xorshift32, returns [0, 1); the seed must be nonzero */
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return (*seed >> 8) * (1.0f / 16777216.0f);
+}
+
 void panic_(const char *str, int line, const char *file, const char *func);
 void expect_(const char *str, int line, const char *file, const char *func);
 int string_to_enum(const char **strings, const char *str);
@@ -1,26 +1,171 @@
 #include <SDL2/SDL.h>
 #include "common.h"
+#include "ring.h"
+#include "wav.h"
+#include "stream.h"
+#include "kernel.h"
 #include "dsp.h"
 
-#define MAX_NODES 10000
+#define MAX_THREADS 16
+#define MAX_MESSAGE 1024
+#define MAX_EVENTS  1024
 
-static Node *nodes[MAX_NODES];
-static int max_node;
+/* ids are a slot index tagged with the slot's generation, so a stale id is
+** rejected rather than finding the slot's new node. Scripts store ids as
+** floats, so ids are kept within 24 bits */
+#define ID_INDEX_BITS 18
+#define ID_GEN_BITS   6
+#define ID_INDEX_MASK ((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK   ((1 << ID_GEN_BITS) - 1)
+#define MAX_NODES     (1 << ID_INDEX_BITS)
+#define CHUNK_SIZE    1024
 
-static FILE *stream_fp;
-static SDL_mutex *stream_lock;
+enum {
+  CMD_ADD, CMD_DESTROY, CMD_LINK, CMD_UNLINK,
+  CMD_SET, CMD_SET_AT, CMD_SMOOTH, CMD_SEND, CMD_TICK, CMD_THREADS, CMD_GROW,
+  CMD_VOICE, CMD_VOICE_NODE, CMD_WAKE
+};
+
+typedef struct {
+  int type, size;
+  Node *node, *node2;
+  int idx, idx2;
+  double value, time;
+  void *ptr;
+} Command;
+
+typedef struct {
+  Node *node;
+  int idx;
+  float value;
+  double time;
+} Event;
+
+typedef struct {
+  Node *node;
+  int dep_count;
+  SDL_atomic_t deps;
+  int *next;
+  int next_count;
+} Task;
+
+typedef struct {
+  SDL_Thread *thread;
+  SDL_sem *sem;
+  SDL_SpinLock lock;
+  int *queue;
+  int head, tail;
+} Worker;
+
+typedef struct {
+  Node *node;
+  int gen, next_free;
+} Slot;
+
+enum { GARBAGE_NODE, GARBAGE_BUFFERS };
+
+typedef struct {
+  int type;
+  void *ptr;
+  int epoch;
+} Garbage;
+
+/* the audio thread's per-node and per-link arrays; these are replaced with
+** larger ones by the script thread as the node count grows */
+typedef struct {
+  int cap, link_cap;
+  Node **live, **outputs, **schedule, **stack;
+  Task *tasks;
+  int *task_next;
+  int *queues[MAX_THREADS];
+} Buffers;
+
+/* a voice is one instance of a pool's subgraph. Its nodes stop being
+** processed once every one of its envelopes has output a silent block, and
+** start again when the voice is given a note */
+typedef struct Voice Voice;
+
+struct Voice {
+  SDL_atomic_t asleep;
+  Node *envs[DSP_MAX_VOICE_ENVS]; /* used by the audio thread */
+  int env_count;
+  int grace;
+  Voice *next;
+  int note, age, wake_epoch;  /* used by the script thread */
+  bool released;
+};
+
+typedef struct {
+  Voice **voices;
+  int voice_count;
+  int clock;
+} VoicePool;
+
+static Slot *slots[MAX_NODES / CHUNK_SIZE];
+static int slot_count;
+static int free_head = -1;
+static int free_tail = -1;
+static int node_count;
+static int link_count;
+static int buffers_cap;
+static int buffers_link_cap;
+
+static Node **live;
+static int live_count;
+static Node **outputs;
+static int output_count;
+
+static Ring commands;
+static Ring errors;
+static Ring garbage;
+static SDL_atomic_t epoch;
+static SDL_atomic_t in_tick;
+
+static Node **schedule;
+static Node **stack;
+static int schedule_count;
+static bool schedule_dirty;
+
+static Task *tasks;
+static int *task_next;
+
+static Worker workers[MAX_THREADS];
+static int thread_count = 1;
+static int active_threads;
+static SDL_atomic_t tasks_remaining;
+
+
+static Event events[MAX_EVENTS];
+static int event_count;
+static Event splits[MAX_EVENTS];
+static int split_count;
+static double block_time;
 
 static DspTickFn tick_callback;
 static double tick_interval = 0.125;
 static double tick_timer;
+static double tick_offset;
+static __thread bool ticking;
+
+static VoicePool **pools;
+static int pool_count;
+static Voice *voices;
 
-static SDL_mutex *lock;
 static SDL_AudioDeviceID dev;
+static int device_period;
+
+static SDL_AudioDeviceID capture_dev;
+static int capture_period;
+static Ring capture;
+static float input_buf[NODE_MAX_BUFFER_SIZE * 2] __attribute__((aligned(NODE_ALIGN)));
 
 
 Node* new_dac_node(void);
+Node* new_adc_node(void);
 Node* new_osc_node(void);
+Node* new_oscbank_node(void);
 Node* new_svf_node(void);
+Node* new_svfbank_node(void);
 Node* new_math_node(void);
 Node* new_line_node(void);
 Node* new_shaper_node(void);
@@ -28,27 +173,379 @@ Node* new_delay_node(void);
 Node* new_reverb_node(void);
 
 static struct { const char *name; NodeConstructor fn; } node_table[] = {
-  { "dac",    new_dac_node    },
-  { "osc",    new_osc_node    },
-  { "svf",    new_svf_node    },
-  { "math",   new_math_node   },
-  { "line",   new_line_node   },
-  { "shaper", new_shaper_node },
-  { "reverb", new_reverb_node },
-  { "delay",  new_delay_node  },
+  { "dac",     new_dac_node     },
+  { "adc",     new_adc_node     },
+  { "osc",     new_osc_node     },
+  { "oscbank", new_oscbank_node },
+  { "svf",     new_svf_node     },
+  { "svfbank", new_svfbank_node },
+  { "math",    new_math_node    },
+  { "line",    new_line_node    },
+  { "shaper",  new_shaper_node  },
+  { "reverb",  new_reverb_node  },
+  { "delay",   new_delay_node   },
   { },
 };
 
 
-static int next_free_id(void) {
-  for (int i = 0; i < MAX_NODES; i++) {
-    if (nodes[i] == NULL) {
-      if (i > max_node) { max_node = i; }
-      return i;
+static Slot* get_slot(int idx) {
+  return &slots[idx / CHUNK_SIZE][idx % CHUNK_SIZE];
+}
+
+
+static int alloc_id(Node *node) {
+  /* reuse the slot that was freed longest ago, so a stale id is unlikely to
+  ** see its generation come round again, else add a slot. Slots are
+  ** allocated a chunk at a time and never move */
+  int idx;
+  if (free_head >= 0) {
+    idx = free_head;
+    free_head = get_slot(idx)->next_free;
+    if (free_head < 0) { free_tail = -1; }
+  } else {
+    if (slot_count == MAX_NODES) { panic("exhausted nodes array"); }
+    if (slot_count % CHUNK_SIZE == 0) {
+      slots[slot_count / CHUNK_SIZE] = calloc(CHUNK_SIZE, sizeof(Slot));
+      expect(slots[slot_count / CHUNK_SIZE]);
+    }
+    idx = slot_count++;
+  }
+  Slot *s = get_slot(idx);
+  s->node = node;
+  return s->gen << ID_INDEX_BITS | idx;
+}
+
+
+static void free_id(int id) {
+  int idx = id & ID_INDEX_MASK;
+  Slot *s = get_slot(idx);
+  s->node = NULL;
+  s->gen = (s->gen + 1) & ID_GEN_MASK;
+  s->next_free = -1;
+  if (free_tail >= 0) {
+    get_slot(free_tail)->next_free = idx;
+  } else {
+    free_head = idx;
+  }
+  free_tail = idx;
+}
+
+
+static Buffers* alloc_buffers(int cap, int link_cap) {
+  Buffers *b = calloc(1, sizeof(Buffers));
+  b->cap = cap;
+  b->link_cap = link_cap;
+  b->live = calloc(cap, sizeof(Node*));
+  b->outputs = calloc(cap, sizeof(Node*));
+  b->schedule = calloc(cap, sizeof(Node*));
+  b->stack = calloc(cap, sizeof(Node*));
+  b->tasks = calloc(cap, sizeof(Task));
+  b->task_next = calloc(link_cap, sizeof(int));
+  for (int i = 0; i < MAX_THREADS; i++) {
+    b->queues[i] = calloc(cap, sizeof(int));
+  }
+  return b;
+}
+
+
+static void free_buffers(Buffers *b) {
+  free(b->live);
+  free(b->outputs);
+  free(b->schedule);
+  free(b->stack);
+  free(b->tasks);
+  free(b->task_next);
+  for (int i = 0; i < MAX_THREADS; i++) {
+    free(b->queues[i]);
+  }
+  free(b);
+}
+
+
+static void free_garbage(Garbage *g) {
+  switch (g->type) {
+    case GARBAGE_NODE    : ((Node*) g->ptr)->vtable->free(g->ptr); break;
+    case GARBAGE_BUFFERS : free_buffers(g->ptr);                   break;
+  }
+}
+
+
+static void retire(int type, void *ptr) {
+  /* memory the audio thread has stopped using is handed to the reclaim
+  ** thread rather than freed here. If the queue is full we have no choice */
+  Garbage g = { type, ptr, SDL_AtomicGet(&epoch) };
+  if (ring_write(&garbage, &g, sizeof(g))) { free_garbage(&g); }
+}
+
+
+static int reclaim_thread(void *udata) {
+  /* garbage is only freed once the block it was retired in has finished,
+  ** at which point nothing on the audio or worker threads can refer to it */
+  Garbage g;
+  bool pending = false;
+  for (;;) {
+    if (!pending) { pending = ring_read(&garbage, &g, sizeof(g)) == 0; }
+    if (pending && SDL_AtomicGet(&epoch) != g.epoch) {
+      free_garbage(&g);
+      pending = false;
+      continue;
+    }
+    SDL_Delay(50);
+  }
+  return 0;
+}
+
+
+static void swap_buffers(Buffers *b) {
+  /* runs on the audio thread between blocks, when the worker queues are
+  ** empty; the live and output lists are carried over, the schedule and
+  ** tasks are rebuilt */
+  for (int i = 0; i < live_count; i++) { b->live[i] = live[i]; }
+  for (int i = 0; i < output_count; i++) { b->outputs[i] = outputs[i]; }
+
+  Node **p;
+  p = live;     live     = b->live;     b->live     = p;
+  p = outputs;  outputs  = b->outputs;  b->outputs  = p;
+  p = schedule; schedule = b->schedule; b->schedule = p;
+  p = stack;    stack    = b->stack;    b->stack    = p;
+  Task *t = tasks; tasks = b->tasks; b->tasks = t;
+  int *n = task_next; task_next = b->task_next; b->task_next = n;
+  for (int i = 0; i < MAX_THREADS; i++) {
+    int *q = workers[i].queue; workers[i].queue = b->queues[i]; b->queues[i] = q;
+  }
+  schedule_dirty = true;
+
+  retire(GARBAGE_BUFFERS, b);
+}
+
+
+static void drain_commands(void);
+
+static void post_command(Command cmd, const char *msg) {
+  char buf[sizeof(cmd) + MAX_MESSAGE];
+  cmd.size = msg ? strlen(msg) + 1 : 0;
+  expect(cmd.size <= MAX_MESSAGE);
+  memcpy(buf, &cmd, sizeof(cmd));
+  if (msg) { memcpy(buf + sizeof(cmd), msg, cmd.size); }
+
+  while (ring_write(&commands, buf, sizeof(cmd) + cmd.size)) {
+    /* the queue is full. Commands are posted with the script lock held, and
+    ** the tick callback holds that lock until it calls dsp_end_tick(), so
+    ** while `in_tick` is set the audio thread is either posting from the
+    ** callback or waiting on the lock, and won't touch the graph: we drain
+    ** the queue ourselves, as we do if there is no audio thread. Otherwise
+    ** wait for the audio thread to catch up */
+    if (!dev || SDL_AtomicGet(&in_tick)) {
+      drain_commands();
+    } else {
+      SDL_Delay(1);
+    }
+  }
+}
+
+
+static void push_event(Node *node, int idx, float value, double time) {
+  /* if the event list is full the event loses its timing */
+  if (event_count == MAX_EVENTS) {
+    node_set_inlet(node, idx, value);
+    return;
+  }
+
+  /* keep events ordered by time; events with equal times stay in the order
+  ** they were posted */
+  int i = event_count++;
+  while (i > 0 && events[i - 1].time > time) {
+    events[i] = events[i - 1];
+    i--;
+  }
+  events[i] = (Event) { node, idx, value, time };
+}
+
+
+static void remove_events(Node *node) {
+  int n = 0;
+  for (int i = 0; i < event_count; i++) {
+    if (events[i].node != node) { events[n++] = events[i]; }
+  }
+  event_count = n;
+}
+
+
+static void apply_events(void) {
+  /* write each event due in this block into its inlet from the event's
+  ** sample offset onwards */
+  double block_end = block_time + node_ctx.buffer_size;
+  int n = 0;
+  split_count = 0;
+  while (n < event_count && events[n].time < block_end) {
+    Event *e = &events[n++];
+    int offset = e->time - block_time;
+    if (offset < 0) { offset = 0; }
+    node_set_inlet_at(e->node, e->idx, e->value, offset);
+    if (offset > 0) { splits[split_count++] = *e; }
+  }
+  memmove(events, events + n, sizeof(Event) * (event_count - n));
+  event_count -= n;
+}
+
+
+static void flatten_splits(void) {
+  /* inlets which changed part way through the block are set to their final
+  ** value so the next block doesn't repeat the step */
+  for (int i = 0; i < split_count; i++) {
+    Event *e = &splits[i];
+    node_set_inlet_at(e->node, e->idx, e->node->inlets[e->idx].value, 0);
+  }
+}
+
+
+static void remove_live(Node *node) {
+  /* move the last live node into this one's slot */
+  Node *last = live[--live_count];
+  live[node->live_idx] = last;
+  last->live_idx = node->live_idx;
+
+  for (int i = 0; i < output_count; i++) {
+    if (outputs[i] == node) {
+      outputs[i] = outputs[--output_count];
+      break;
+    }
+  }
+}
+
+
+static void remove_voice_env(Node *node) {
+  Voice *v = node->voice;
+  for (int i = 0; i < v->env_count; i++) {
+    if (v->envs[i] == node) {
+      v->envs[i] = v->envs[--v->env_count];
+      break;
+    }
+  }
+}
+
+
+static void apply_command(Command *cmd, const char *msg) {
+  char err[NODE_MAX_ERROR];
+
+  switch (cmd->type) {
+    case CMD_ADD:
+      cmd->node->live_idx = live_count;
+      live[live_count++] = cmd->node;
+      if (strcmp(cmd->node->info->name, "dac") == 0) {
+        outputs[output_count++] = cmd->node;
+      }
+      schedule_dirty = true;
+      break;
+
+    case CMD_DESTROY:
+      /* unlink the node now, it's freed once this block is done */
+      remove_events(cmd->node);
+      remove_live(cmd->node);
+      if (cmd->node->voice) { remove_voice_env(cmd->node); }
+      node_deinit(cmd->node);
+      retire(GARBAGE_NODE, cmd->node);
+      schedule_dirty = true;
+      break;
+
+    case CMD_LINK:
+      node_link(cmd->node, cmd->idx, cmd->node2, cmd->idx2);
+      schedule_dirty = true;
+      break;
+
+    case CMD_UNLINK:
+      node_unlink(cmd->node, cmd->idx, cmd->node2, cmd->idx2);
+      schedule_dirty = true;
+      break;
+
+    case CMD_SET:
+      node_set_inlet(cmd->node, cmd->idx, cmd->value);
+      break;
+
+    case CMD_SET_AT:
+      push_event(cmd->node, cmd->idx, cmd->value, block_time + cmd->time);
+      break;
+
+    case CMD_SMOOTH:
+      node_smooth_inlet(cmd->node, cmd->idx, cmd->idx2, cmd->value);
+      break;
+
+    case CMD_SEND:
+      /* a message may change what an idle node would output */
+      cmd->node->idle = false;
+      if (cmd->node->vtable->receive(cmd->node, msg, err)) {
+        ring_write(&errors, err, sizeof(err));
+      }
+      break;
+
+    case CMD_TICK:
+      tick_interval = cmd->value;
+      break;
+
+    case CMD_THREADS:
+      thread_count = cmd->idx;
+      break;
+
+    case CMD_GROW:
+      swap_buffers(cmd->ptr);
+      break;
+
+    case CMD_VOICE: {
+      Voice *v = cmd->ptr;
+      v->next = voices;
+      voices = v;
+      break;
     }
+
+    case CMD_VOICE_NODE: {
+      Voice *v = cmd->ptr;
+      if (cmd->node->voice) { remove_voice_env(cmd->node); }
+      cmd->node->voice = v;
+      if (cmd->idx) { v->envs[v->env_count++] = cmd->node; }
+      break;
+    }
+
+    case CMD_WAKE: {
+      /* give the voice about a second to start its envelopes before it can
+      ** be put back to sleep */
+      Voice *v = cmd->ptr;
+      SDL_AtomicSet(&v->asleep, 0);
+      v->grace = node_ctx.samplerate / node_ctx.buffer_size;
+      break;
+    }
+  }
+}
+
+
+static void drain_commands(void) {
+  Command cmd;
+  char msg[MAX_MESSAGE];
+  while (ring_read(&commands, &cmd, sizeof(cmd)) == 0) {
+    /* the message is always written along with its command */
+    ring_read(&commands, msg, cmd.size);
+    apply_command(&cmd, msg);
   }
-  panic("exhausted nodes array");
-  return 0; /* never reached */
+}
+
+
+static int count_links(Node *node) {
+  /* the most links the node's inlets can hold */
+  int n = 0;
+  while (node->info->inlets[n]) { n++; }
+  return n * NODE_MAX_LINKS;
+}
+
+
+static void reserve_buffers(int count, int links) {
+  /* the audio thread's arrays must be grown before it sees the node that
+  ** would overflow them */
+  if (count <= buffers_cap && links <= buffers_link_cap) { return; }
+  while (buffers_cap < count) { buffers_cap = buffers_cap ? buffers_cap * 2 : CHUNK_SIZE; }
+  while (buffers_link_cap < links) {
+    buffers_link_cap = buffers_link_cap ? buffers_link_cap * 2 : CHUNK_SIZE * NODE_MAX_LINKS;
+  }
+  Buffers *b = alloc_buffers(buffers_cap, buffers_link_cap);
+  post_command((Command) { CMD_GROW, .ptr = b }, NULL);
 }
 
 
@@ -56,10 +553,11 @@ int dsp_new_node(const char *name) {
   for (int i = 0; node_table[i].name; i++) {
     if (strcmp(node_table[i].name, name) == 0) {
       Node *node = node_table[i].fn();
-      SDL_LockMutex(lock);
-      int id = next_free_id();
-      nodes[id] = node;
-      SDL_UnlockMutex(lock);
+      reserve_buffers(node_count + 1, link_count + count_links(node));
+      int id = alloc_id(node);
+      node_count++;
+      link_count += count_links(node);
+      post_command((Command) { CMD_ADD, .node = node }, NULL);
       return id;
     }
   }
@@ -70,110 +568,774 @@ int dsp_new_node(const char *name) {
 int dsp_destroy_node(int id) {
   Node *node = dsp_get_node(id);
   if (!node) { return -1; }
-  SDL_LockMutex(lock);
-  nodes[id] = NULL;
-  node->vtable->free(node);
-  SDL_UnlockMutex(lock);
+  free_id(id);
+  node_count--;
+  link_count -= count_links(node);
+  post_command((Command) { CMD_DESTROY, .node = node }, NULL);
   return 0;
 }
 
 
+int dsp_link(Node *from, const char *outlet, Node *to, const char *inlet) {
+  int idx1 = string_to_enum(from->info->outlets, outlet);
+  int idx2 = string_to_enum(  to->info->inlets,  inlet );
+  if (idx1 < 0) { return NODE_EBADOUTLET; }
+  if (idx2 < 0) { return NODE_EBADINLET;  }
+
+  /* the link counts can only be changed by our own queued commands; this
+  ** catches all but links still in the queue, which the audio thread drops */
+  if (from->outlets[idx1].link_count == NODE_MAX_LINKS) { return NODE_EMAXLINKS; }
+  if (  to->inlets[idx2].link_count  == NODE_MAX_LINKS) { return NODE_EMAXLINKS; }
+
+  Command cmd = { CMD_LINK, .node = from, .node2 = to, .idx = idx1, .idx2 = idx2 };
+  post_command(cmd, NULL);
+  return NODE_ESUCCESS;
+}
+
+
+int dsp_unlink(Node *from, const char *outlet, Node *to, const char *inlet) {
+  int idx1 = string_to_enum(from->info->outlets, outlet);
+  int idx2 = string_to_enum(  to->info->inlets,  inlet );
+  if (idx1 < 0) { return NODE_EBADOUTLET; }
+  if (idx2 < 0) { return NODE_EBADINLET;  }
+
+  Command cmd = { CMD_UNLINK, .node = from, .node2 = to, .idx = idx1, .idx2 = idx2 };
+  post_command(cmd, NULL);
+  return NODE_ESUCCESS;
+}
+
+
+int dsp_set(Node *node, const char *inlet, float value) {
+  int idx = string_to_enum(node->info->inlets, inlet);
+  if (idx < 0) { return NODE_EBADINLET; }
+  post_command((Command) { CMD_SET, .node = node, .idx = idx, .value = value }, NULL);
+  return NODE_ESUCCESS;
+}
+
+
+int dsp_set_at(Node *node, const char *inlet, float value, double t) {
+  int idx = string_to_enum(node->info->inlets, inlet);
+  if (idx < 0) { return NODE_EBADINLET; }
+
+  /* time is relative to the tick when called from the tick callback, else to
+  ** the start of the block the event is received in. `ticking` is only set
+  ** on the thread running the callback, so a script thread posting while
+  ** the callback waits on its lock isn't offset */
+  double time = maxf(t, 0) * node_ctx.samplerate;
+  if (ticking) { time += tick_offset; }
+  time = floor(time + 0.5);
+
+  Command cmd = { CMD_SET_AT, .node = node, .idx = idx, .value = value, .time = time };
+  post_command(cmd, NULL);
+  return NODE_ESUCCESS;
+}
+
+
+int dsp_smooth(Node *node, const char *inlet, int mode, float time) {
+  int idx = string_to_enum(node->info->inlets, inlet);
+  if (idx < 0) { return NODE_EBADINLET; }
+  Command cmd = { CMD_SMOOTH, .node = node, .idx = idx, .idx2 = mode, .value = time };
+  post_command(cmd, NULL);
+  return NODE_ESUCCESS;
+}
+
+
+void dsp_send(Node *node, const char *msg) {
+  post_command((Command) { CMD_SEND, .node = node }, msg);
+}
+
+
+static VoicePool* get_pool(int id) {
+  if (id < 0 || id >= pool_count) { return NULL; }
+  return pools[id];
+}
+
+
+int dsp_new_voice_pool(void) {
+  pools = realloc(pools, sizeof(*pools) * (pool_count + 1));
+  expect(pools);
+  pools[pool_count] = calloc(1, sizeof(VoicePool));
+  expect(pools[pool_count]);
+  return pool_count++;
+}
+
+
+int dsp_add_voice(int pool, Node **nodes, int count, Node **envs, int env_count) {
+  VoicePool *p = get_pool(pool);
+  if (!p || env_count > DSP_MAX_VOICE_ENVS) { return -1; }
+
+  Voice *v = calloc(1, sizeof(Voice));
+  expect(v);
+  v->note = -1;
+  v->released = true;
+  p->voices = realloc(p->voices, sizeof(*p->voices) * (p->voice_count + 1));
+  expect(p->voices);
+  p->voices[p->voice_count] = v;
+
+  post_command((Command) { CMD_VOICE, .ptr = v }, NULL);
+  for (int i = 0; i < count; i++) {
+    post_command((Command) { CMD_VOICE_NODE, .node = nodes[i], .ptr = v }, NULL);
+  }
+  for (int i = 0; i < env_count; i++) {
+    post_command((Command) { CMD_VOICE_NODE, .node = envs[i], .ptr = v, .idx = 1 }, NULL);
+  }
+  return p->voice_count++;
+}
+
+
+static bool voice_is_asleep(Voice *v) {
+  /* the flag is stale until the audio thread has had a whole block to see
+  ** our last wake command */
+  return SDL_AtomicGet(&v->asleep) && SDL_AtomicGet(&epoch) - v->wake_epoch > 1;
+}
+
+
+int dsp_note_on(int pool, int note) {
+  VoicePool *p = get_pool(pool);
+  if (!p || p->voice_count == 0) { return -1; }
+
+  /* prefer the voice already playing this note, then the oldest sleeping
+  ** voice, then the voice released longest ago, then steal the oldest */
+  int best = 0, best_rank = 4;
+  for (int i = 0; i < p->voice_count; i++) {
+    Voice *v = p->voices[i];
+    int rank = 3;
+    if (!v->released && v->note == note) { rank = 0; }
+    else if (voice_is_asleep(v))         { rank = 1; }
+    else if (v->released)                { rank = 2; }
+    if (rank < best_rank || (rank == best_rank && v->age < p->voices[best]->age)) {
+      best = i;
+      best_rank = rank;
+    }
+  }
+
+  Voice *v = p->voices[best];
+  v->note = note;
+  v->released = false;
+  v->age = ++p->clock;
+  v->wake_epoch = SDL_AtomicGet(&epoch);
+  post_command((Command) { CMD_WAKE, .ptr = v }, NULL);
+  return best;
+}
+
+
+int dsp_note_off(int pool, int note) {
+  VoicePool *p = get_pool(pool);
+  if (!p) { return -1; }
+  for (int i = 0; i < p->voice_count; i++) {
+    Voice *v = p->voices[i];
+    if (!v->released && v->note == note) {
+      v->released = true;
+      v->age = ++p->clock;
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+int dsp_poll_error(char *buf) {
+  return ring_read(&errors, buf, NODE_MAX_ERROR) == 0;
+}
+
+
 Node* dsp_get_node(int id) {
-  if (id < 0 || id > max_node) { return NULL; }
-  return nodes[id];
+  int idx = id & ID_INDEX_MASK;
+  if (id < 0 || idx >= slot_count) { return NULL; }
+  Slot *s = get_slot(idx);
+  if (s->gen != id >> ID_INDEX_BITS) { return NULL; }
+  return s->node;
 }
 
 
-void process_nodes(float *buf) {
-  /* process all nodes */
-  for (int i = 0; i <= max_node; i++) {
-    if (!nodes[i]) { continue; }
-    nodes[i]->vtable->process(nodes[i]);
+static void push_schedule(Node *node) {
+  node->sched_deps = -1;
+  schedule[schedule_count++] = node;
+}
+
+
+static void build_tasks(void) {
+  /* every link becomes a dependency from whichever end is scheduled first
+  ** to the other: a feedback link's reader must finish before its writer
+  ** overwrites the outlet. A node linked to itself needs no dependency. The
+  ** successor array holds one entry per link, and is sized for the most
+  ** links the live nodes' inlets can hold */
+  for (int i = 0; i < schedule_count; i++) {
+    schedule[i]->sched_idx = i;
+    tasks[i] = (Task) { .node = schedule[i] };
+  }
+
+  /* count successors and dependencies */
+  for (int i = 0; i < schedule_count; i++) {
+    Node *node = schedule[i];
+    for (int j = 0; node->info->inlets[j]; j++) {
+      NodePort *inlet = &node->inlets[j];
+      for (int k = 0; k < inlet->link_count; k++) {
+        int a = inlet->links[k].node->sched_idx;
+        int b = i;
+        if (a == b) { continue; }
+        if (a > b) { int t = a; a = b; b = t; }
+        tasks[a].next_count++;
+        tasks[b].dep_count++;
+      }
+    }
+  }
+
+  /* assign each task its slice of the successor array and fill it */
+  int *p = task_next;
+  for (int i = 0; i < schedule_count; i++) {
+    tasks[i].next = p;
+    p += tasks[i].next_count;
+    tasks[i].next_count = 0;
+  }
+  for (int i = 0; i < schedule_count; i++) {
+    Node *node = schedule[i];
+    for (int j = 0; node->info->inlets[j]; j++) {
+      NodePort *inlet = &node->inlets[j];
+      for (int k = 0; k < inlet->link_count; k++) {
+        int a = inlet->links[k].node->sched_idx;
+        int b = i;
+        if (a == b) { continue; }
+        if (a > b) { int t = a; a = b; b = t; }
+        tasks[a].next[tasks[a].next_count++] = b;
+      }
+    }
+  }
+}
+
+
+static Node* next_successor(Node *node) {
+  /* steps the node's `sched_edge` cursor through the links of its outlets */
+  for (;;) {
+    int j = node->sched_edge / NODE_MAX_LINKS;
+    int i = node->sched_edge % NODE_MAX_LINKS;
+    if (!node->info->outlets[j]) { return NULL; }
+    if (i < node->outlets[j].link_count) {
+      node->sched_edge++;
+      return node->outlets[j].links[i].node;
+    }
+    node->sched_edge = (j + 1) * NODE_MAX_LINKS;
+  }
+}
+
+
+static void visit(Node *node, int *index, int *depth, int *top) {
+  node->sched_idx = node->sched_low = (*index)++;
+  node->sched_comp = -1;
+  node->sched_edge = 0;
+  stack[(*depth)++] = node;
+  schedule[(*top)++] = node;
+}
+
+
+static void find_components(void) {
+  /* Tarjan's algorithm, with an explicit stack rather than recursion; the
+  ** schedule array is free until it is built so it holds the unfinished
+  ** nodes. Components are numbered in reverse topological order, so links
+  ** between components always lead to a lower numbered one */
+  int index = 0, depth = 0, top = 0, comp = 0;
+  for (int i = 0; i < live_count; i++) { live[i]->sched_idx = -1; }
+
+  for (int i = 0; i < live_count; i++) {
+    if (live[i]->sched_idx >= 0) { continue; }
+    visit(live[i], &index, &depth, &top);
+
+    while (depth > 0) {
+      Node *node = stack[depth - 1];
+      Node *next = next_successor(node);
+      if (next) {
+        if (next->sched_idx < 0) {
+          visit(next, &index, &depth, &top);
+        } else if (next->sched_comp < 0 && next->sched_idx < node->sched_low) {
+          node->sched_low = next->sched_idx;
+        }
+        continue;
+      }
+
+      depth--;
+      if (depth > 0 && node->sched_low < stack[depth - 1]->sched_low) {
+        stack[depth - 1]->sched_low = node->sched_low;
+      }
+      if (node->sched_low == node->sched_idx) {
+        Node *n;
+        do {
+          n = schedule[--top];
+          n->sched_comp = comp;
+        } while (n != node);
+        comp++;
+      }
+    }
+  }
+}
+
+
+static void build_schedule(void) {
+  /* count each node's incoming links; the links may have changed so inlets
+  ** are re-pointed at the outlets they read */
+  for (int i = 0; i < live_count; i++) {
+    Node *node = live[i];
+    node_alias_inlets(node);
+    node->sched_deps = 0;
+    for (int j = 0; node->info->inlets[j]; j++) {
+      node->sched_deps += node->inlets[j].link_count;
+    }
   }
+  find_components();
 
-  /* reset output buffer */
-  memset(buf, 0, sizeof(float) * NODE_BUFFER_SIZE * 2);
+  /* schedule nodes with no incoming links first */
+  schedule_count = 0;
+  for (int i = 0; i < live_count; i++) {
+    if (live[i]->sched_deps == 0) { push_schedule(live[i]); }
+  }
 
-  /* copy dac outlet buffers to provided buffer */
-  for (int i = 0; i <= max_node; i++) {
-    if (!nodes[i]) { continue; }
-    if (strcmp(nodes[i]->info->name, "dac") == 0) {
-      for (int j = 0; j < NODE_BUFFER_SIZE; j++) {
-        buf[j*2+0] += nodes[i]->outlets[0].buf[j];
-        buf[j*2+1] += nodes[i]->outlets[1].buf[j];
+  /* walk the schedule, adding nodes once all the nodes they depend on are
+  ** scheduled. If we run out of ready nodes the remaining ones are in or
+  ** downstream of a feedback cycle. The unscheduled node in the highest
+  ** numbered component is forced: nothing unscheduled links into that
+  ** component from outside, so only its links from inside the cycle are
+  ** heard with one block of delay */
+  int head = 0;
+  while (schedule_count < live_count) {
+    if (head == schedule_count) {
+      Node *forced = NULL;
+      for (int i = 0; i < live_count; i++) {
+        Node *n = live[i];
+        if (n->sched_deps > 0 && (!forced || n->sched_comp > forced->sched_comp)) {
+          forced = n;
+        }
       }
+      push_schedule(forced);
+    }
+    Node *node = schedule[head++];
+    for (int j = 0; node->info->outlets[j]; j++) {
+      NodePort *outlet = &node->outlets[j];
+      for (int i = 0; i < outlet->link_count; i++) {
+        Node *next = outlet->links[i].node;
+        if (next->sched_deps > 0 && --next->sched_deps == 0) {
+          push_schedule(next);
+        }
+      }
+    }
+  }
+
+  build_tasks();
+  schedule_dirty = false;
+}
+
+
+static void push_task(Worker *w, int idx) {
+  SDL_AtomicLock(&w->lock);
+  w->queue[w->tail++] = idx;
+  SDL_AtomicUnlock(&w->lock);
+}
+
+
+static int pop_task(Worker *w) {
+  /* owner takes the most recently pushed task */
+  int idx = -1;
+  SDL_AtomicLock(&w->lock);
+  if (w->tail > w->head) {
+    idx = w->queue[--w->tail];
+    if (w->tail == w->head) { w->head = w->tail = 0; }
+  }
+  SDL_AtomicUnlock(&w->lock);
+  return idx;
+}
+
+
+static int steal_task(Worker *w) {
+  /* thieves take the oldest task from the other end */
+  int idx = -1;
+  if (!SDL_AtomicTryLock(&w->lock)) { return -1; }
+  if (w->tail > w->head) {
+    idx = w->queue[w->head++];
+    if (w->tail == w->head) { w->head = w->tail = 0; }
+  }
+  SDL_AtomicUnlock(&w->lock);
+  return idx;
+}
+
+
+static bool is_asleep(Node *node) {
+  Voice *v = node->voice;
+  return v && SDL_AtomicGet(&v->asleep);
+}
+
+
+static void run_tasks(int worker_idx) {
+  Worker *w = &workers[worker_idx];
+  while (SDL_AtomicGet(&tasks_remaining) > 0) {
+    int idx = pop_task(w);
+    for (int i = 1; idx < 0 && i < active_threads; i++) {
+      idx = steal_task(&workers[(worker_idx + i) % active_threads]);
+    }
+    if (idx < 0) { continue; }
+
+    /* process node, then release any tasks that were only waiting on it */
+    Task *t = &tasks[idx];
+    if (!is_asleep(t->node)) { node_process(t->node); }
+    for (int i = 0; i < t->next_count; i++) {
+      Task *next = &tasks[t->next[i]];
+      if (SDL_AtomicAdd(&next->deps, -1) == 1) { push_task(w, t->next[i]); }
+    }
+    SDL_AtomicAdd(&tasks_remaining, -1);
+  }
+}
+
+
+static int worker_thread(void *udata) {
+  int idx = (intptr_t) udata;
+  for (;;) {
+    SDL_SemWait(workers[idx].sem);
+    run_tasks(idx);
+  }
+  return 0;
+}
+
+
+static void process_parallel(void) {
+  /* reset dependency counters -- this must be complete before any task is
+  ** made available, as a worker still spinning from the last block may pick
+  ** one up immediately */
+  for (int i = 0; i < schedule_count; i++) {
+    SDL_AtomicSet(&tasks[i].deps, tasks[i].dep_count);
+  }
+  active_threads = thread_count;
+  SDL_AtomicSet(&tasks_remaining, schedule_count);
+
+  /* deal out the tasks that are ready */
+  int n = 0;
+  for (int i = 0; i < schedule_count; i++) {
+    if (tasks[i].dep_count == 0) {
+      push_task(&workers[n++ % active_threads], i);
     }
   }
+
+  /* wake workers; the audio thread works as worker 0 until all are done */
+  for (int i = 1; i < active_threads; i++) {
+    SDL_SemPost(workers[i].sem);
+  }
+  run_tasks(0);
 }
 
+
+static void sleep_voice(Voice *v) {
+  /* sleeping nodes aren't processed, so clear what they last output */
+  SDL_AtomicSet(&v->asleep, 1);
+  for (int i = 0; i < live_count; i++) {
+    Node *node = live[i];
+    if (node->voice != v) { continue; }
+    for (int j = 0; node->info->outlets[j]; j++) {
+      memset(node->outlets[j].buf, 0, sizeof(float) * node_ctx.buffer_size);
+      node->outlets[j].constant = true;
+    }
+    node->idle = false;
+  }
+}
+
+
+static void update_voices(void) {
+  /* put voices to sleep once all their envelopes have output a silent block */
+  for (Voice *v = voices; v; v = v->next) {
+    if (v->env_count == 0 || SDL_AtomicGet(&v->asleep)) { continue; }
+    bool silent = true;
+    for (int i = 0; i < v->env_count && silent; i++) {
+      float *buf = v->envs[i]->outlets[0].buf;
+      for (int j = 0; j < node_ctx.buffer_size; j++) {
+        if (buf[j] != 0) { silent = false; break; }
+      }
+    }
+    if (!silent) {
+      v->grace = 0;
+    } else if (v->grace > 0) {
+      v->grace--;
+    } else {
+      sleep_voice(v);
+    }
+  }
+}
+
+
+void process_nodes(float *buf) {
+  /* apply changes posted since the last block, then timed events */
+  drain_commands();
+  apply_events();
+
+  /* rebuild execution order if the graph has changed */
+  if (schedule_dirty) { build_schedule(); }
+
+  /* process all nodes */
+  if (thread_count > 1) {
+    process_parallel();
+  } else {
+    for (int i = 0; i < schedule_count; i++) {
+      if (!is_asleep(schedule[i])) { node_process(schedule[i]); }
+    }
+  }
+
+  /* sum dac outlet buffers and interleave them into the provided buffer */
+  static float left[NODE_MAX_BUFFER_SIZE] __attribute__((aligned(NODE_ALIGN)));
+  static float right[NODE_MAX_BUFFER_SIZE] __attribute__((aligned(NODE_ALIGN)));
+  memset(left, 0, sizeof(float) * node_ctx.buffer_size);
+  memset(right, 0, sizeof(float) * node_ctx.buffer_size);
+  for (int i = 0; i < output_count; i++) {
+    Node *node = outputs[i];
+    kernel_add(left, node->outlets[0].buf, node_ctx.buffer_size);
+    kernel_add(right, node->outlets[1].buf, node_ctx.buffer_size);
+  }
+  kernel_interleave(buf, left, right, node_ctx.buffer_size);
+
+  update_voices();
+  flatten_splits();
+  block_time += node_ctx.buffer_size;
+  SDL_AtomicAdd(&epoch, 1);
+}
+
+static void run_ticks(void) {
+  /* call the tick callback for every tick falling within the next block;
+  ** timed events posted from the callback are offset to the tick's exact
+  ** position in the block */
+  const double block_duration = node_ctx.sampletime * node_ctx.buffer_size;
+  while (tick_timer < block_duration) {
+    tick_offset = tick_timer * node_ctx.samplerate;
+    SDL_AtomicSet(&in_tick, 1);
+    ticking = true;
+    if (tick_callback) { tick_callback(); }
+    ticking = false;
+    dsp_end_tick();
+    tick_timer += tick_interval;
+  }
+  tick_timer -= block_duration;
+}
+
+
+static void read_input(void) {
+  const int block_bytes = sizeof(float) * node_ctx.buffer_size * 2;
+
+  /* keep no more than a device period or block queued so if the capture
+  ** device runs ahead of the output device the input-to-output latency
+  ** can't creep up. The oldest audio is dropped a block at a time, and only
+  ** while that still leaves a full backlog to read this block from */
+  const int period = maxf(maxf(capture_period, device_period), node_ctx.buffer_size);
+  const int max_bytes = sizeof(float) * period * 2;
+  while (ring_count(&capture) - block_bytes >= max_bytes) {
+    ring_read(&capture, input_buf, block_bytes);
+  }
+
+  /* use silence if the capture device has fallen behind */
+  if (ring_read(&capture, input_buf, block_bytes)) {
+    memset(input_buf, 0, block_bytes);
+  }
+}
+
+
+static void process_block(float *buf) {
+  if (capture_dev) { read_input(); }
+
+  /* drain first so a changed tick interval applies to this block's ticks */
+  drain_commands();
+  run_ticks();
+  process_nodes(buf);
+}
+
+
 static void process(float *buf, int len) {
-  static float temp_buf[NODE_BUFFER_SIZE * 2];
-  static int   temp_buf_idx = 0;
+  static float temp_buf[NODE_MAX_BUFFER_SIZE * 2];
+  static int   temp_buf_idx = NODE_MAX_BUFFER_SIZE * 2;
+  const int block_len = node_ctx.buffer_size * 2;
 
-  for (int i = 0; i < len; i++) {
-    /* copy from internal buffer to provided buffer */
-    buf[i] = temp_buf[temp_buf_idx++];
+  int i = 0;
+  while (i < len) {
+    /* render whole blocks straight into the provided buffer when nothing is
+    ** left over from the last call; if the device period is a multiple of
+    ** the block size this is always the case */
+    if (temp_buf_idx >= block_len && len - i >= block_len) {
+      process_block(buf + i);
+      i += block_len;
+      continue;
+    }
 
     /* refill internal buffer if its been exhaused */
-    if (temp_buf_idx == NODE_BUFFER_SIZE * 2) {
-      SDL_LockMutex(lock);
-      process_nodes(temp_buf);
-      SDL_UnlockMutex(lock);
+    if (temp_buf_idx >= block_len) {
+      process_block(temp_buf);
       temp_buf_idx = 0;
     }
 
-    /* handle tick timer */
-    if (temp_buf_idx == 0) {
-      tick_timer -= NODE_SAMPLETIME * NODE_BUFFER_SIZE;
-      while (tick_timer < 0) {
-        if (tick_callback) { tick_callback(); }
-        tick_timer += tick_interval;
-      }
-    }
+    /* copy from internal buffer to provided buffer */
+    int n = block_len - temp_buf_idx;
+    if (n > len - i) { n = len - i; }
+    memcpy(buf + i, temp_buf + temp_buf_idx, sizeof(float) * n);
+    temp_buf_idx += n;
+    i += n;
   }
 }
 
 
 static void audio_callback(void *udata, uint8_t *buf, int len) {
   process((float*) buf, len / sizeof(float));
-  SDL_LockMutex(stream_lock);
-  if (stream_fp) { fwrite(buf, len, 1, stream_fp); }
-  SDL_UnlockMutex(stream_lock);
+  stream_write(buf, len);
+}
+
+
+static void capture_callback(void *udata, uint8_t *buf, int len) {
+  /* if the queue is full the output device has stalled; drop the audio */
+  ring_write(&capture, buf, len);
 }
 
 
-void dsp_init(DspTickFn tickfn) {
+void dsp_init(DspTickFn tickfn, int samplerate, int buffer_size) {
+  expect(samplerate > 0);
+  expect(buffer_size > 0 && buffer_size <= NODE_MAX_BUFFER_SIZE);
+  node_ctx.samplerate = samplerate;
+  node_ctx.buffer_size = buffer_size;
+  node_ctx.sampletime = 1.0 / samplerate;
+
+  node_ctx.input = input_buf;
+  kernel_init();
+
   tick_callback = tickfn;
-  lock = SDL_CreateMutex();
-  stream_lock = SDL_CreateMutex();
+  ring_init(&commands, 1 << 18);
+  ring_init(&errors, NODE_MAX_ERROR * 16);
+  ring_init(&garbage, 1 << 20);
+  stream_init();
+
+  SDL_Thread *thread = SDL_CreateThread(reclaim_thread, "DSP Reclaim", NULL);
+  expect(thread);
+  SDL_DetachThread(thread);
+}
+
+
+static int period_samples(int period) {
+  /* SDL wants a power-of-two period that fits its 16-bit sample count */
+  int samples = 1;
+  while (samples < period && samples < 32768) { samples <<= 1; }
+  return samples;
+}
+
+
+int dsp_open_device(const char *name, int period) {
   SDL_AudioSpec fmt = {
-    .freq = 44100,
+    .freq = node_ctx.samplerate,
     .format = AUDIO_F32,
     .channels = 2,
-    .samples = 1024,
+    .samples = period_samples(period),
     .callback = audio_callback,
   };
-  dev = SDL_OpenAudioDevice(NULL, 0, &fmt, NULL, 0);
-  expect(dev);
+
+  /* let the backend pick a different period if it can't do the one asked
+  ** for, `process()` copes with any period. Older SDL versions always give
+  ** us the period asked for, buffering internally. A NULL name opens the
+  ** default device */
+#ifdef SDL_AUDIO_ALLOW_SAMPLES_CHANGE
+  const int allow = SDL_AUDIO_ALLOW_SAMPLES_CHANGE;
+#else
+  const int allow = 0;
+#endif
+  SDL_AudioSpec got;
+  dev = SDL_OpenAudioDevice(name, 0, &fmt, &got, allow);
+  if (!dev) { return -1; }
+
+  device_period = got.samples;
   SDL_PauseAudioDevice(dev, 0);
+  return 0;
 }
 
 
-void dsp_set_tick(double t) {
-  tick_interval = t;
+int dsp_get_period(void) {
+  return device_period;
 }
 
 
-int dsp_set_stream(const char *filename) {
-  if (stream_fp) {
-    SDL_LockMutex(stream_lock);
-    fclose(stream_fp);
-    stream_fp = NULL;
-    SDL_UnlockMutex(stream_lock);
+int dsp_open_input(const char *name, int period) {
+  /* must be called before `dsp_open_device()` as the audio thread reads the
+  ** capture queue without synchronisation once it's open */
+  expect(!dev);
+
+  SDL_AudioSpec fmt = {
+    .freq = node_ctx.samplerate,
+    .format = AUDIO_F32,
+    .channels = 2,
+    .samples = period_samples(period),
+    .callback = capture_callback,
+  };
+  SDL_AudioSpec got;
+  SDL_AudioDeviceID id = SDL_OpenAudioDevice(name, 1, &fmt, &got, 0);
+  if (!id) { return -1; }
+
+  /* room for a few periods so a late output callback doesn't lose input */
+  int size = 1;
+  while (size < (got.samples + NODE_MAX_BUFFER_SIZE) * sizeof(float) * 2 * 4) {
+    size <<= 1;
   }
-  if (filename) {
-    stream_fp = fopen(filename, "wb");
-    if (!stream_fp) { return -1; }
+  ring_init(&capture, size);
+  capture_period = got.samples;
+  capture_dev = id;
+  SDL_PauseAudioDevice(capture_dev, 0);
+  return 0;
+}
+
+
+int dsp_render(const char *filename, double seconds, DspErrorFn fn) {
+  expect(!dev);
+  WavFile wav;
+  if (wav_open(&wav, filename, node_ctx.samplerate, 2, 32)) { return -1; }
+
+  /* run the engine on this thread as fast as it will go; there's no frame
+  ** loop to poll for node errors so they're passed to `fn` as they occur */
+  float buf[NODE_MAX_BUFFER_SIZE * 2];
+  char err[NODE_MAX_ERROR];
+  int frames = seconds * node_ctx.samplerate;
+  while (frames > 0) {
+    process_block(buf);
+    while (dsp_poll_error(err)) { fn(err); }
+    int n = frames < node_ctx.buffer_size ? frames : node_ctx.buffer_size;
+    wav_write(&wav, buf, n);
+    frames -= n;
   }
+
+  wav_close(&wav);
   return 0;
 }
+
+
+void dsp_set_threads(int n) {
+  /* workers spin while waiting on dependencies, so never use more threads
+  ** than there are cores */
+  int max = SDL_GetCPUCount();
+  if (max > MAX_THREADS) { max = MAX_THREADS; }
+  n = n < 1 ? 1 : n > max ? max : n;
+  for (int i = 1; i < n; i++) {
+    Worker *w = &workers[i];
+    if (w->thread) { continue; }
+    w->sem = SDL_CreateSemaphore(0);
+    w->thread = SDL_CreateThread(worker_thread, "DSP Worker", (void*) (intptr_t) i);
+    expect(w->thread);
+  }
+  post_command((Command) { CMD_THREADS, .idx = n }, NULL);
+}
+
+
+void dsp_end_tick(void) {
+  /* the tick callback calls this before releasing the lock it posts under;
+  ** once the lock is released the audio thread may be processing again */
+  SDL_AtomicSet(&in_tick, 0);
+}
+
+
+void dsp_set_tick(double t) {
+  post_command((Command) { CMD_TICK, .value = t }, NULL);
+}
+
+
+int dsp_set_stream(const char *filename, int bits) {
+  if (!filename) {
+    stream_close();
+    return 0;
+  }
+  return stream_open(filename, node_ctx.samplerate, 2, bits);
+}
+
+
+int dsp_get_stream_overruns(void) {
+  return stream_overruns();
+}
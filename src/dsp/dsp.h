@@ -3,13 +3,34 @@
 
 #include "node.h"
 
+#define DSP_MAX_VOICE_ENVS 8
+
 typedef void (*DspTickFn)(void);
+typedef void (*DspErrorFn)(const char *err);
 
-void dsp_init(DspTickFn fn);
+void dsp_init(DspTickFn fn, int samplerate, int buffer_size);
+int dsp_open_device(const char *name, int period);
+int dsp_get_period(void);
+int dsp_open_input(const char *name, int period);
+int dsp_render(const char *filename, double seconds, DspErrorFn fn);
+void dsp_set_threads(int n);
 void dsp_set_tick(double t);
-int dsp_set_stream(const char *filename);
+void dsp_end_tick(void);
+int dsp_set_stream(const char *filename, int bits);
+int dsp_get_stream_overruns(void);
 int dsp_new_node(const char *name);
 int dsp_destroy_node(int id);
+int dsp_link(Node *from, const char *outlet, Node *to, const char *inlet);
+int dsp_unlink(Node *from, const char *outlet, Node *to, const char *inlet);
+int dsp_set(Node *node, const char *inlet, float value);
+int dsp_set_at(Node *node, const char *inlet, float value, double t);
+int dsp_smooth(Node *node, const char *inlet, int mode, float time);
+void dsp_send(Node *node, const char *msg);
+int dsp_new_voice_pool(void);
+int dsp_add_voice(int pool, Node **nodes, int count, Node **envs, int env_count);
+int dsp_note_on(int pool, int note);
+int dsp_note_off(int pool, int note);
+int dsp_poll_error(char *buf);
 Node* dsp_get_node(int id);
 
 #endif
@@ -0,0 +1,304 @@
+#include <SDL2/SDL.h>
+#include <math.h>
+#include "common.h"
+#include "kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define KERNEL_AVX2
+  #include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+  #define KERNEL_SSE2
+  #include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+  #define KERNEL_NEON
+  #include <arm_neon.h>
+#endif
+
+typedef struct {
+  void (*add)(float *dst, const float *src, int n);
+  void (*mul)(float *dst, const float *src, int n);
+  void (*scale)(float *dst, float k, int n);
+  void (*clamp)(float *dst, float lo, float hi, int n);
+  void (*interleave)(float *dst, const float *l, const float *r, int n);
+  void (*deinterleave)(float *l, float *r, const float *src, int n);
+  float (*peak)(const float *src, int n);
+} Kernels;
+
+
+/* plain C versions; the vector versions use these for any remainder */
+
+static void scalar_add(float *dst, const float *src, int n) {
+  for (int i = 0; i < n; i++) { dst[i] += src[i]; }
+}
+
+static void scalar_mul(float *dst, const float *src, int n) {
+  for (int i = 0; i < n; i++) { dst[i] *= src[i]; }
+}
+
+static void scalar_scale(float *dst, float k, int n) {
+  for (int i = 0; i < n; i++) { dst[i] *= k; }
+}
+
+static void scalar_clamp(float *dst, float lo, float hi, int n) {
+  for (int i = 0; i < n; i++) { dst[i] = minf(maxf(dst[i], lo), hi); }
+}
+
+static void scalar_interleave(float *dst, const float *l, const float *r, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i*2+0] = l[i];
+    dst[i*2+1] = r[i];
+  }
+}
+
+static void scalar_deinterleave(float *l, float *r, const float *src, int n) {
+  for (int i = 0; i < n; i++) {
+    l[i] = src[i*2+0];
+    r[i] = src[i*2+1];
+  }
+}
+
+static float scalar_peak(const float *src, int n) {
+  float res = 0;
+  for (int i = 0; i < n; i++) { res = maxf(res, fabsf(src[i])); }
+  return res;
+}
+
+static Kernels scalar = {
+  scalar_add, scalar_mul, scalar_scale,
+  scalar_clamp, scalar_interleave, scalar_deinterleave, scalar_peak
+};
+
+
+/* the element-wise kernels only differ between instruction sets in their
+** vector width and intrinsics, and their results match the plain C versions
+** exactly */
+#define define_kernels(isa, attr, W, vec, load, store, set1, add, mul, min, max) \
+  attr static void isa##_add(float *dst, const float *src, int n) {             \
+    int i = 0;                                                                 \
+    for (; i + W <= n; i += W) {                                               \
+      store(dst + i, add(load(dst + i), load(src + i)));                       \
+    }                                                                          \
+    scalar_add(dst + i, src + i, n - i);                                       \
+  }                                                                            \
+  attr static void isa##_mul(float *dst, const float *src, int n) {             \
+    int i = 0;                                                                 \
+    for (; i + W <= n; i += W) {                                               \
+      store(dst + i, mul(load(dst + i), load(src + i)));                       \
+    }                                                                          \
+    scalar_mul(dst + i, src + i, n - i);                                       \
+  }                                                                            \
+  attr static void isa##_scale(float *dst, float k, int n) {                    \
+    int i = 0;                                                                 \
+    vec kv = set1(k);                                                          \
+    for (; i + W <= n; i += W) {                                               \
+      store(dst + i, mul(load(dst + i), kv));                                  \
+    }                                                                          \
+    scalar_scale(dst + i, k, n - i);                                           \
+  }                                                                            \
+  attr static void isa##_clamp(float *dst, float lo, float hi, int n) {         \
+    int i = 0;                                                                 \
+    vec lov = set1(lo), hiv = set1(hi);                                        \
+    for (; i + W <= n; i += W) {                                               \
+      store(dst + i, min(max(load(dst + i), lov), hiv));                       \
+    }                                                                          \
+    scalar_clamp(dst + i, lo, hi, n - i);                                      \
+  }
+
+
+#ifdef KERNEL_SSE2
+
+define_kernels(sse2, , 4, __m128, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps,
+               _mm_add_ps, _mm_mul_ps, _mm_min_ps, _mm_max_ps)
+
+static void sse2_interleave(float *dst, const float *l, const float *r, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(l + i);
+    __m128 b = _mm_loadu_ps(r + i);
+    _mm_storeu_ps(dst + i*2 + 0, _mm_unpacklo_ps(a, b));
+    _mm_storeu_ps(dst + i*2 + 4, _mm_unpackhi_ps(a, b));
+  }
+  scalar_interleave(dst + i*2, l + i, r + i, n - i);
+}
+
+static void sse2_deinterleave(float *l, float *r, const float *src, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_loadu_ps(src + i*2 + 0);
+    __m128 b = _mm_loadu_ps(src + i*2 + 4);
+    _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  scalar_deinterleave(l + i, r + i, src + i*2, n - i);
+}
+
+static float sse2_peak(const float *src, int n) {
+  int i = 0;
+  __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 m = _mm_setzero_ps();
+  for (; i + 4 <= n; i += 4) {
+    m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(src + i), mask));
+  }
+  float v[4];
+  _mm_storeu_ps(v, m);
+  float res = maxf(maxf(v[0], v[1]), maxf(v[2], v[3]));
+  return maxf(res, scalar_peak(src + i, n - i));
+}
+
+static Kernels sse2 = {
+  sse2_add, sse2_mul, sse2_scale,
+  sse2_clamp, sse2_interleave, sse2_deinterleave, sse2_peak
+};
+
+#endif
+
+
+#ifdef KERNEL_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+define_kernels(avx2, AVX2, 8, __m256, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps,
+               _mm256_add_ps, _mm256_mul_ps, _mm256_min_ps, _mm256_max_ps)
+
+AVX2 static void avx2_interleave(float *dst, const float *l, const float *r, int n) {
+  /* unpacking works within each 128-bit lane, so the lanes are swapped
+  ** back into order afterwards */
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 a = _mm256_loadu_ps(l + i);
+    __m256 b = _mm256_loadu_ps(r + i);
+    __m256 lo = _mm256_unpacklo_ps(a, b);
+    __m256 hi = _mm256_unpackhi_ps(a, b);
+    _mm256_storeu_ps(dst + i*2 + 0, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + i*2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  scalar_interleave(dst + i*2, l + i, r + i, n - i);
+}
+
+AVX2 static void avx2_deinterleave(float *l, float *r, const float *src, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 a = _mm256_loadu_ps(src + i*2 + 0);
+    __m256 b = _mm256_loadu_ps(src + i*2 + 8);
+    __m256 ls = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 rs = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    ls = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(ls), _MM_SHUFFLE(3, 1, 2, 0)));
+    rs = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(rs), _MM_SHUFFLE(3, 1, 2, 0)));
+    _mm256_storeu_ps(l + i, ls);
+    _mm256_storeu_ps(r + i, rs);
+  }
+  scalar_deinterleave(l + i, r + i, src + i*2, n - i);
+}
+
+AVX2 static float avx2_peak(const float *src, int n) {
+  int i = 0;
+  __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 m = _mm256_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_max_ps(m, _mm256_and_ps(_mm256_loadu_ps(src + i), mask));
+  }
+  float v[8];
+  _mm256_storeu_ps(v, m);
+  float res = 0;
+  for (int j = 0; j < 8; j++) { res = maxf(res, v[j]); }
+  return maxf(res, scalar_peak(src + i, n - i));
+}
+
+static Kernels avx2 = {
+  avx2_add, avx2_mul, avx2_scale,
+  avx2_clamp, avx2_interleave, avx2_deinterleave, avx2_peak
+};
+
+#endif
+
+
+#ifdef KERNEL_NEON
+
+define_kernels(neon, , 4, float32x4_t, vld1q_f32, vst1q_f32, vdupq_n_f32,
+               vaddq_f32, vmulq_f32, vminq_f32, vmaxq_f32)
+
+static void neon_interleave(float *dst, const float *l, const float *r, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4x2_t v = { { vld1q_f32(l + i), vld1q_f32(r + i) } };
+    vst2q_f32(dst + i*2, v);
+  }
+  scalar_interleave(dst + i*2, l + i, r + i, n - i);
+}
+
+static void neon_deinterleave(float *l, float *r, const float *src, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4x2_t v = vld2q_f32(src + i*2);
+    vst1q_f32(l + i, v.val[0]);
+    vst1q_f32(r + i, v.val[1]);
+  }
+  scalar_deinterleave(l + i, r + i, src + i*2, n - i);
+}
+
+static float neon_peak(const float *src, int n) {
+  int i = 0;
+  float32x4_t m = vdupq_n_f32(0);
+  for (; i + 4 <= n; i += 4) {
+    m = vmaxq_f32(m, vabsq_f32(vld1q_f32(src + i)));
+  }
+  float v[4];
+  vst1q_f32(v, m);
+  float res = maxf(maxf(v[0], v[1]), maxf(v[2], v[3]));
+  return maxf(res, scalar_peak(src + i, n - i));
+}
+
+static Kernels neon = {
+  neon_add, neon_mul, neon_scale,
+  neon_clamp, neon_interleave, neon_deinterleave, neon_peak
+};
+
+#endif
+
+
+static Kernels *kernels = &scalar;
+
+
+void kernel_init(void) {
+  kernels = &scalar;
+#ifdef KERNEL_SSE2
+  kernels = &sse2;
+#endif
+#ifdef KERNEL_NEON
+  kernels = &neon;
+#endif
+#ifdef KERNEL_AVX2
+  if (SDL_HasAVX2()) { kernels = &avx2; }
+#endif
+}
+
+
+void kernel_add(float *dst, const float *src, int n) {
+  kernels->add(dst, src, n);
+}
+
+void kernel_mul(float *dst, const float *src, int n) {
+  kernels->mul(dst, src, n);
+}
+
+void kernel_scale(float *dst, float k, int n) {
+  kernels->scale(dst, k, n);
+}
+
+void kernel_clamp(float *dst, float lo, float hi, int n) {
+  kernels->clamp(dst, lo, hi, n);
+}
+
+void kernel_interleave(float *dst, const float *l, const float *r, int n) {
+  kernels->interleave(dst, l, r, n);
+}
+
+void kernel_deinterleave(float *l, float *r, const float *src, int n) {
+  kernels->deinterleave(l, r, src, n);
+}
+
+float kernel_peak(const float *src, int n) {
+  return kernels->peak(src, n);
+}
@@ -0,0 +1,16 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+/* vectorized loops over float buffers. Buffers need not be aligned, though
+** they're faster if they are. Until `kernel_init()` picks the best versions
+** the cpu supports, plain C versions are used */
+void kernel_init(void);
+void kernel_add(float *dst, const float *src, int n);
+void kernel_mul(float *dst, const float *src, int n);
+void kernel_scale(float *dst, float k, int n);
+void kernel_clamp(float *dst, float lo, float hi, int n);
+void kernel_interleave(float *dst, const float *l, const float *r, int n);
+void kernel_deinterleave(float *l, float *r, const float *src, int n);
+float kernel_peak(const float *src, int n);
+
+#endif
@@ -1,5 +1,47 @@
+#include <SDL2/SDL.h>
+#include "kernel.h"
 #include "node.h"
 
+NodeContext node_ctx = { 44100, 64, 1.0 / 44100, NULL };
+
+
+#define POOL_SLAB_SIZE 65536
+
+
+void* node_pool_alloc(NodePool *pool) {
+  /* the audio thread may be freeing into the pool, so the lock is only
+  ** held to touch the free list */
+  SDL_AtomicLock(&pool->lock);
+  void *p = pool->free_list;
+  if (p) { pool->free_list = *(void**) p; }
+  SDL_AtomicUnlock(&pool->lock);
+
+  if (!p) {
+    /* allocate a slab, keep its first object and free the rest */
+    int size = (pool->size + NODE_ALIGN - 1) & ~(NODE_ALIGN - 1);
+    int count = maxf(POOL_SLAB_SIZE / size, 1);
+    char *slab = malloc(size * count + NODE_ALIGN - 1);
+    expect(slab);
+    slab += -(intptr_t) slab & (NODE_ALIGN - 1);
+    p = slab;
+    for (int i = 1; i < count; i++) {
+      node_pool_free(pool, slab + i * size);
+    }
+  }
+
+  /* objects come back zeroed, as if from `calloc()` */
+  memset(p, 0, pool->size);
+  return p;
+}
+
+
+void node_pool_free(NodePool *pool, void *p) {
+  SDL_AtomicLock(&pool->lock);
+  *(void**) p = pool->free_list;
+  pool->free_list = p;
+  SDL_AtomicUnlock(&pool->lock);
+}
+
 
 void node_init(Node *node, NodeInfo *info, NodeVtable *vtable, NodePort *inlets, NodePort *outlets) {
   memset(node, 0, sizeof(Node));
@@ -7,6 +49,16 @@ void node_init(Node *node, NodeInfo *info, NodeVtable *vtable, NodePort *inlets,
   node->vtable = vtable;
   node->inlets = inlets;
   node->outlets = outlets;
+
+  /* ports start out silent */
+  for (int j = 0; info->inlets[j]; j++) {
+    inlets[j].buf = inlets[j].data;
+    inlets[j].constant = true;
+  }
+  for (int j = 0; info->outlets[j]; j++) {
+    outlets[j].buf = outlets[j].data;
+    outlets[j].constant = true;
+  }
 }
 
 
@@ -23,20 +75,29 @@ static int remove_link(NodePort *port, Node *node, int idx) {
 
 
 void node_deinit(Node *node) {
-  /* unlink all nodes linked to this node */
+  /* unlink all nodes linked to this node; calling this again is harmless */
   for (int j = 0; node->info->inlets[j]; j++) {
     NodePort *inlet = &node->inlets[j];
     for (int i = 0; i < inlet->link_count; i++) {
       NodeLink *link = &inlet->links[i];
       remove_link(&link->node->outlets[link->idx], node, j);
     }
+    inlet->link_count = 0;
+  }
+  for (int j = 0; node->info->outlets[j]; j++) {
+    NodePort *outlet = &node->outlets[j];
+    for (int i = 0; i < outlet->link_count; i++) {
+      NodeLink *link = &outlet->links[i];
+      remove_link(&link->node->inlets[link->idx], node, j);
+    }
+    outlet->link_count = 0;
   }
 }
 
 
 void node_free(Node *node) {
   node_deinit(node);
-  free(node);
+  node_pool_free(node->info->pool, node);
 }
 
 
@@ -46,36 +107,126 @@ int node_receive(Node *node, const char *str, char *err) {
 }
 
 
-static void mix_buffer(float *dst, float *src, int len) {
+bool node_idle(Node *node) {
+  /* for nodes whose output depends only on their inlets */
+  return true;
+}
+
+
+static void fill_buffer(float *dst, float value, int len) {
   for (int i = 0; i < len; i++) {
-    dst[i] += src[i];
+    dst[i] = value;
+  }
+}
+
+
+static void fill_inlet(NodePort *p) {
+  /* advance a smoothed inlet towards its target value */
+  for (int i = 0; i < node_ctx.buffer_size; i++) {
+    if (p->smooth == NODE_SMOOTH_LINEAR) {
+      if (p->steps > 0) { p->value += p->step; p->steps--; }
+      if (p->steps == 0) { p->value = p->target; }
+    } else {
+      p->value += (p->target - p->value) * p->coef;
+    }
+    p->data[i] = p->value;
+  }
+  /* snap once we're close enough that the remaining steps would be lost to
+  ** float precision; once the target is reached the buffer still needs one
+  ** more fill to flatten out */
+  if (fabs(p->target - p->value) <= fabs(p->target) * 1e-5 + 1e-7) {
+    p->value = p->target;
+  }
+  p->ramping = p->data[0] != p->target;
+  p->constant = !p->ramping;
+}
+
+
+static bool is_constant(float *buf) {
+  for (int i = 1; i < node_ctx.buffer_size; i++) {
+    if (buf[i] != buf[0]) { return false; }
+  }
+  return true;
+}
+
+
+void node_alias_inlets(Node *node) {
+  /* called whenever links change. A self-link isn't aliased, as the node
+  ** would then read the outlet it's writing. An inlet that stops aliasing
+  ** copies the buffer so it keeps the last audio it heard */
+  for (int j = 0; node->info->inlets[j]; j++) {
+    NodePort *inlet = &node->inlets[j];
+    float *buf = inlet->data;
+    if (inlet->link_count == 1 && inlet->links[0].node != node) {
+      NodeLink *link = &inlet->links[0];
+      buf = link->node->outlets[link->idx].buf;
+    }
+    if (buf == inlet->data && inlet->buf != inlet->data) {
+      memcpy(inlet->data, inlet->buf, sizeof(inlet->data));
+    }
+    inlet->buf = buf;
   }
 }
 
 
 void node_process(Node *node) {
-  /* send all audio from outlets to connected inlets */
-  for (int j = 0; node->info->outlets[j]; j++) {
-    NodePort *outlet = &node->outlets[j];
+  /* pull audio from linked outlets into inlets; inlets without links keep
+  ** the value they were last set to, or move towards it if smoothed. The
+  ** inlets are steady if each is constant and unchanged since last block */
+  bool steady = true;
+  for (int j = 0; node->info->inlets[j]; j++) {
+    NodePort *inlet = &node->inlets[j];
+    if (inlet->link_count == 0) {
+      if (inlet->ramping) { fill_inlet(inlet); }
+      steady = steady && inlet->constant;
+      continue;
+    }
 
-    for (int i = 0; i < outlet->link_count; i++) {
-      NodeLink *link = &outlet->links[i];
-      NodePort *inlet = &link->node->inlets[link->idx];
-
-      /* replace audio if `replace` flag is set, otherwise mix */
-      if (inlet->replace) {
-        memcpy(inlet->buf, outlet->buf, sizeof(outlet->buf));
-        inlet->replace = false;
-      } else {
-        mix_buffer(inlet->buf, outlet->buf, NODE_BUFFER_SIZE);
+    bool was_constant = inlet->constant;
+
+    /* if every linked outlet is constant only their first samples need
+    ** summing, and the buffer only needs filling if the sum has changed */
+    float sum = 0;
+    inlet->constant = true;
+    for (int i = 0; i < inlet->link_count; i++) {
+      NodeLink *link = &inlet->links[i];
+      NodePort *outlet = &link->node->outlets[link->idx];
+      inlet->constant = inlet->constant && outlet->constant;
+      sum += outlet->buf[0];
+    }
+
+    if (inlet->buf != inlet->data) {
+      /* aliased, see `node_alias_inlets()` */
+    } else if (inlet->constant) {
+      if (!was_constant || sum != inlet->data[0]) { fill_buffer(inlet->data, sum, node_ctx.buffer_size); }
+    } else {
+      for (int i = 0; i < inlet->link_count; i++) {
+        NodeLink *link = &inlet->links[i];
+        NodePort *outlet = &link->node->outlets[link->idx];
+
+        /* replace audio with the first link, mix the rest */
+        if (i == 0) {
+          memcpy(inlet->buf, outlet->buf, sizeof(float) * node_ctx.buffer_size);
+        } else {
+          kernel_add(inlet->buf, outlet->buf, node_ctx.buffer_size);
+        }
       }
     }
+
+    steady = steady && was_constant && inlet->constant && inlet->buf[0] == inlet->last;
+    inlet->last = inlet->buf[0];
   }
 
-  /* reset `replace` flag on all inlets -- causes the next outlet write to
-  ** replace the buffer's existing audio instead of mixing to it */
-  for (int i = 0; node->info->inlets[i]; i++) {
-    node->inlets[i].replace = true;
+  /* an idle node's outlets still hold what it would output */
+  if (node->idle && steady) { return; }
+
+  node->vtable->process(node);
+
+  node->idle = steady && node->vtable->idle && node->vtable->idle(node);
+  for (int j = 0; node->info->outlets[j]; j++) {
+    NodePort *outlet = &node->outlets[j];
+    outlet->constant = is_constant(outlet->buf);
+    node->idle = node->idle && outlet->constant;
   }
 }
 
@@ -90,12 +241,62 @@ static int string_index(const char **arr, const char *name) {
 }
 
 
+void node_set_inlet(Node *node, int idx, float value) {
+  NodePort *p = &node->inlets[idx];
+  /* scripts often set inlets every frame whether or not they've changed */
+  if (!p->ramping && p->constant && p->data[0] == value) { return; }
+  switch (p->smooth) {
+    case NODE_SMOOTH_OFF:
+      node_set_inlet_at(node, idx, value, 0);
+      break;
+    case NODE_SMOOTH_LINEAR:
+      p->steps = maxf(p->coef * node_ctx.samplerate, 1);
+      p->step = (value - p->value) / p->steps;
+      p->target = value;
+      p->ramping = true;
+      break;
+    case NODE_SMOOTH_ONEPOLE:
+      p->target = value;
+      p->ramping = true;
+      break;
+  }
+}
+
+
+void node_set_inlet_at(Node *node, int idx, float value, int offset) {
+  /* steps to the value at the given sample offset, bypassing smoothing */
+  NodePort *p = &node->inlets[idx];
+  bool changed = p->ramping || !p->constant || p->data[0] != value;
+  if (p->ramping) { fill_inlet(p); }
+  for (int i = offset; i < node_ctx.buffer_size; i++) {
+    p->data[i] = value;
+  }
+  p->value = p->target = value;
+  p->ramping = false;
+  p->constant = offset == 0 || !changed;
+
+  /* an idle node only needs waking if the value is new */
+  if (changed) { node->idle = false; }
+}
+
+
+void node_smooth_inlet(Node *node, int idx, int mode, float time) {
+  /* `coef` holds the ramp time for linear smoothing, or the per-sample
+  ** coefficient for one-pole smoothing */
+  NodePort *p = &node->inlets[idx];
+  p->smooth = mode;
+  switch (mode) {
+    case NODE_SMOOTH_LINEAR  : p->coef = time; break;
+    case NODE_SMOOTH_ONEPOLE : p->coef = 1.0 - exp(-node_ctx.sampletime / maxf(time, node_ctx.sampletime)); break;
+  }
+  if (mode == NODE_SMOOTH_OFF) { node_set_inlet(node, idx, p->target); }
+}
+
+
 int node_set(Node *node, const char *inlet, float value) {
   int idx = string_index(node->info->inlets, inlet);
   if (idx < 0) { return NODE_EBADINLET; }
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    node->inlets[idx].buf[i] = value;
-  }
+  node_set_inlet(node, idx, value);
   return NODE_ESUCCESS;
 }
 
@@ -103,41 +304,31 @@ int node_set(Node *node, const char *inlet, float value) {
 int node_get(Node *node, const char *outlet, float *value) {
   int idx = string_index(node->info->outlets, outlet);
   if (idx < 0) { return NODE_EBADOUTLET; }
-  *value = node->outlets[idx].buf[NODE_BUFFER_SIZE - 1];
+  *value = node->outlets[idx].buf[node_ctx.buffer_size - 1];
   return NODE_ESUCCESS;
 }
 
 
-int node_link(Node *from, const char *outlet, Node *to, const char *inlet) {
+int node_link(Node *from, int outlet, Node *to, int inlet) {
   node_unlink(from, outlet, to, inlet);
-  int idx1 = string_index(from->info->outlets, outlet);
-  int idx2 = string_index(  to->info->inlets,  inlet );
-  if (idx1 < 0) { return NODE_EBADOUTLET; }
-  if (idx2 < 0) { return NODE_EBADINLET;  }
-
-  NodePort *out = &from->outlets[idx1];
-  NodePort *in = &to->inlets[idx2];
+  NodePort *out = &from->outlets[outlet];
+  NodePort *in = &to->inlets[inlet];
   if (out->link_count == NODE_MAX_LINKS) { return NODE_EMAXLINKS; }
   if (in->link_count  == NODE_MAX_LINKS) { return NODE_EMAXLINKS; }
 
-  out->links[out->link_count++] = (NodeLink) { to,   idx2 };
-  in ->links[in ->link_count++] = (NodeLink) { from, idx1 };
+  out->links[out->link_count++] = (NodeLink) { to,   inlet  };
+  in ->links[in ->link_count++] = (NodeLink) { from, outlet };
 
   return NODE_ESUCCESS;
 }
 
 
-int node_unlink(Node *from, const char *outlet, Node *to, const char *inlet) {
-  int idx1 = string_index(from->info->outlets, outlet);
-  int idx2 = string_index(  to->info->inlets,  inlet );
-  if (idx1 < 0) { return NODE_EBADOUTLET; }
-  if (idx2 < 0) { return NODE_EBADINLET;  }
-
-  int err = remove_link(&from->outlets[idx1], to, idx2);
+int node_unlink(Node *from, int outlet, Node *to, int inlet) {
+  int err = remove_link(&from->outlets[outlet], to, inlet);
   if (err) { return NODE_EBADLINK; }
 
   /* this call should always succeed if the previous `remove_link` did */
-  remove_link(&to->inlets[idx2], from, idx1);
+  remove_link(&to->inlets[inlet], from, outlet);
 
   return NODE_ESUCCESS;
 }
@@ -4,11 +4,20 @@
 #include <math.h>
 #include "common.h"
 
-#define NODE_SAMPLERATE  44100
-#define NODE_SAMPLETIME  (1.0 / NODE_SAMPLERATE)
-#define NODE_BUFFER_SIZE 64
-#define NODE_MAX_LINKS   32
-#define NODE_MAX_ERROR   128
+#define NODE_MAX_BUFFER_SIZE 256
+#define NODE_MAX_LINKS       32
+#define NODE_MAX_ERROR       128
+#define NODE_ALIGN           32
+
+/* level below which a decaying tail is treated as silence (about -100dB) */
+#define NODE_SILENCE 0.00001
+
+/* multichannel nodes run NODE_LANES independent channels side by side,
+** keeping a value for each channel in a NodeLanes vector. A channel of a
+** port `name` is the port `name1`..`name8`, so each channel can be linked
+** on its own; a `mix` outlet, if any, is their sum */
+#define NODE_LANES 8
+typedef float NodeLanes __attribute__((vector_size(NODE_LANES * sizeof(float))));
 
 enum {
   NODE_ESUCCESS   =  0,
@@ -19,28 +28,69 @@ enum {
   NODE_EMAXLINKS  = -5,
 };
 
+enum {
+  NODE_SMOOTH_OFF,
+  NODE_SMOOTH_LINEAR,
+  NODE_SMOOTH_ONEPOLE,
+};
+
+/* engine settings; these are set by `dsp_init()` and must not change once
+** nodes exist. Only the first `buffer_size` samples of port buffers are used.
+** `input` holds the current block of captured audio as interleaved stereo */
+typedef struct {
+  int samplerate;
+  int buffer_size;
+  double sampletime;
+  const float *input;
+} NodeContext;
+
+extern NodeContext node_ctx;
+
 typedef struct Node Node;
 typedef Node* (*NodeConstructor)(void);
 
 typedef struct { Node *node; int idx; } NodeLink;
 
+/* an inlet with a single link reads straight from the linked outlet's buffer
+** rather than copying it into its own */
 typedef struct {
-  float buf[NODE_BUFFER_SIZE];
+  float *buf;    /* `data`, or the buffer of the outlet an inlet reads from */
+  float data[NODE_MAX_BUFFER_SIZE] __attribute__((aligned(NODE_ALIGN)));
   NodeLink links[NODE_MAX_LINKS];
   int link_count;
-  bool replace;
+  int smooth, steps;
+  bool ramping;
+  bool constant; /* every sample of `buf` holds `buf[0]` */
+  float last;    /* `buf[0]` as of the last block, for linked inlets */
+  float value, target, step, coef;
 } NodePort;
 
+/* `idle` is optional. It is called after a block in which every inlet held
+** the same constant value as in the block before, and returns true if the
+** node's outlets would keep their values for as long as its inlets do; it
+** may clear a decayed tail to make this so. The node then isn't processed
+** again until an inlet changes or it receives a message */
 typedef struct {
   int (*receive)(Node *node, const char *str, char *err);
   void (*process)(Node *node);
   void (*free)(Node *node);
+  bool (*idle)(Node *node);
 } NodeVtable;
 
+/* recycles freed memory of a single size. Memory is allocated in slabs of
+** several objects and never returned to the system. Objects are aligned to
+** `NODE_ALIGN` so port buffers suit vector loads */
+typedef struct {
+  int size;
+  void *free_list;
+  int lock; /* SDL_SpinLock */
+} NodePool;
+
 typedef struct {
   const char *name;
   const char **inlets;
   const char **outlets;
+  NodePool *pool;
 } NodeInfo;
 
 struct Node {
@@ -48,16 +98,27 @@ struct Node {
   NodeVtable *vtable;
   NodePort *inlets;
   NodePort *outlets;
+  int sched_deps, sched_idx, live_idx; /* used by the dsp scheduler */
+  int sched_low, sched_comp, sched_edge;
+  void *voice;                         /* used by the dsp voice pools */
+  bool idle;                           /* used by `node_process()` */
 };
 
+void* node_pool_alloc(NodePool *pool);
+void node_pool_free(NodePool *pool, void *p);
 void node_init(Node *node, NodeInfo *info, NodeVtable *vtable, NodePort *inlets, NodePort *outlets);
 void node_deinit(Node *node);
 void node_free(Node *node);
+void node_alias_inlets(Node *node);
 void node_process(Node *node);
 int node_receive(Node *node, const char *str, char *err);
+bool node_idle(Node *node);
+void node_set_inlet(Node *node, int idx, float value);
+void node_set_inlet_at(Node *node, int idx, float value, int offset);
+void node_smooth_inlet(Node *node, int idx, int mode, float time);
 int node_set(Node *node, const char *inlet, float value);
 int node_get(Node *node, const char *outlet, float *value);
-int node_link(Node *from, const char *outlet, Node *to, const char *inlet);
-int node_unlink(Node *from, const char *outlet, Node *to, const char *inlet);
+int node_link(Node *from, int outlet, Node *to, int inlet);
+int node_unlink(Node *from, int outlet, Node *to, int inlet);
 
 #endif
@@ -0,0 +1,41 @@
+#include "../kernel.h"
+#include "../node.h"
+
+
+typedef struct {
+  Node node;
+  NodePort outl, outr; /* outlets */
+} AdcNode;
+
+
+static void process(Node *node) {
+  AdcNode *n = (AdcNode*) node;
+
+  /* deinterleave the current block of captured audio */
+  kernel_deinterleave(n->outl.buf, n->outr.buf, node_ctx.input, node_ctx.buffer_size);
+}
+
+
+Node* new_adc_node(void) {
+  static const char *inlets[] = { NULL };
+  static const char *outlets[] = { "left", "right", NULL };
+
+  static NodePool pool = { sizeof(AdcNode) };
+
+  static NodeInfo info = {
+    .name = "adc",
+    .inlets = inlets,
+    .outlets = outlets,
+    .pool = &pool,
+  };
+
+  static NodeVtable vtable = {
+    .process = process,
+    .receive = node_receive,
+    .free = node_free,
+  };
+
+  AdcNode *node = node_pool_alloc(&pool);
+  node_init(&node->node, &info, &vtable, NULL, &node->outl);
+  return &node->node;
+}
@@ -12,32 +12,32 @@ static void process(Node *node) {
   DacNode *n = (DacNode*) node;
 
   /* copy inlet buffers to outlet buffers */
-  memcpy(n->outl.buf, n->inl.buf, sizeof(n->outl.buf));
-  memcpy(n->outr.buf, n->inr.buf, sizeof(n->outr.buf));
-
-  /* send output */
-  node_process(node);
+  memcpy(n->outl.buf, n->inl.buf, sizeof(float) * node_ctx.buffer_size);
+  memcpy(n->outr.buf, n->inr.buf, sizeof(float) * node_ctx.buffer_size);
 }
 
 
 Node* new_dac_node(void) {
-  DacNode *node = calloc(1, sizeof(DacNode));
-
   static const char *inlets[] = { "left", "right", NULL };
   static const char *outlets[] = { "left", "right", NULL };
 
+  static NodePool pool = { sizeof(DacNode) };
+
   static NodeInfo info = {
     .name = "dac",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = node_receive,
     .free = node_free,
+    .idle = node_idle,
   };
 
+  DacNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->inl, &node->outl);
   return &node->node;
 }
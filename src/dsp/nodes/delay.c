@@ -3,14 +3,16 @@
 static const char *cmd_strings[] = { "wet", "dry", NULL };
 enum { WET, DRY };
 
-#define BUFFER_SIZE 65536
-#define BUFFER_MASK (BUFFER_SIZE - 1)
+/* the buffer is sized to hold at least this many seconds */
+#define MAX_TIME 1.4
 
 typedef struct {
   Node node;
-  int idx;
+  int idx, mask;
+  int quiet;    /* samples written since one was above `NODE_SILENCE` */
+  bool cleared; /* the buffer has been zeroed since then */
   float wet, dry;
-  float buf[BUFFER_SIZE];
+  float *buf;
   NodePort in, time, feedback; /* inlets */
   NodePort out;                /* outlets */
 } DelayNode;
@@ -19,25 +21,43 @@ typedef struct {
 static void process(Node *node) {
   DelayNode *n = (DelayNode*) node;
 
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
+  for (int i = 0; i < node_ctx.buffer_size; i++) {
     /* read */
-    double fidx = n->idx - fabs(n->time.buf[i]) * NODE_SAMPLERATE;
+    double fidx = n->idx - fabs(n->time.buf[i]) * node_ctx.samplerate;
     float frac = fmod(fidx, 1.0);
-    int idx1 = (int) fidx & BUFFER_MASK;
-    int idx2 = (idx1 + 1) & BUFFER_MASK;
+    int idx1 = (int) fidx & n->mask;
+    int idx2 = (idx1 + 1) & n->mask;
     float out = lerpf(n->buf[idx1], n->buf[idx2], frac);
 
     /* write */
     float in = n->in.buf[i];
-    n->buf[n->idx] = in + out * n->feedback.buf[i];
-    n->idx = (n->idx + 1) & BUFFER_MASK;
+    float x = in + out * n->feedback.buf[i];
+    n->buf[n->idx] = x;
+    n->idx = (n->idx + 1) & n->mask;
+    if (fabs(x) > NODE_SILENCE) {
+      n->quiet = 0;
+      n->cleared = false;
+    } else if (n->quiet <= n->mask) {
+      n->quiet++;
+    }
 
     /* output */
     n->out.buf[i] = out * n->wet + in * n->dry;
   }
+}
+
 
-  /* send output */
-  node_process(node);
+static bool idle(Node *node) {
+  /* the tail has died away once the whole buffer has been written quietly;
+  ** what's left in it is cleared once rather than each time we go idle */
+  DelayNode *n = (DelayNode*) node;
+  if (n->quiet <= n->mask) { return false; }
+  if (!n->cleared) {
+    memset(n->buf, 0, sizeof(float) * (n->mask + 1));
+    n->cleared = true;
+  }
+  memset(n->out.buf, 0, sizeof(float) * node_ctx.buffer_size);
+  return true;
 }
 
 
@@ -61,25 +81,47 @@ static int receive(Node *node, const char *msg, char *err) {
 }
 
 
-Node* new_delay_node(void) {
-  DelayNode *node = calloc(1, sizeof(DelayNode));
+static NodePool buf_pool;
+
+
+static void free_node(Node *node) {
+  DelayNode *n = (DelayNode*) node;
+  node_pool_free(&buf_pool, n->buf);
+  node_free(node);
+}
 
+
+Node* new_delay_node(void) {
   static const char *inlets[] = { "in", "time", "feedback", NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(DelayNode) };
+
   static NodeInfo info = {
     .name = "delay",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
-    .free = node_free,
+    .free = free_node,
+    .idle = idle,
   };
 
+  DelayNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->in, &node->out);
+
+  /* power-of-two sized so indices can wrap with a mask. The samplerate is
+  ** fixed before any node exists so every buffer is the same size */
+  int size = 1;
+  while (size < MAX_TIME * node_ctx.samplerate) { size <<= 1; }
+  buf_pool.size = size * sizeof(float);
+  node->buf = node_pool_alloc(&buf_pool);
+  node->mask = size - 1;
+
   node->wet = 1.0;
   node->dry = 0.0;
   node_set(&node->node, "feedback", 0.5);
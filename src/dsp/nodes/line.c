@@ -25,8 +25,8 @@ static void handle_next_point(LineNode *n) {
   }
 
   Point p = n->points[n->point_idx];
-  n->step = (p.value - n->cur) * NODE_SAMPLETIME / p.time;
-  n->counter = p.time * NODE_SAMPLERATE;
+  n->step = (p.value - n->cur) * node_ctx.sampletime / p.time;
+  n->counter = p.time * node_ctx.samplerate;
 }
 
 
@@ -34,7 +34,7 @@ static void process(Node *node) {
   LineNode *n = (LineNode*) node;
 
   /* update */
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
+  for (int i = 0; i < node_ctx.buffer_size; i++) {
     n->out.buf[i] = n->cur;
     if (!n->active) { continue; }
 
@@ -46,9 +46,11 @@ static void process(Node *node) {
       handle_next_point(n);
     }
   }
+}
+
 
-  /* send output */
-  node_process(node);
+static bool idle(Node *node) {
+  return !((LineNode*) node)->active;
 }
 
 
@@ -83,23 +85,26 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_line_node(void) {
-  LineNode *node = calloc(1, sizeof(LineNode));
-
   static const char *inlets[] = { NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(LineNode) };
+
   static NodeInfo info = {
     .name = "line",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
     .free = node_free,
+    .idle = idle,
   };
 
+  LineNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, NULL, &node->out);
   node->active = false;
 
@@ -1,12 +1,20 @@
+#include "../kernel.h"
 #include "../node.h"
 
 static const char *op_strings[] = { "+", "*", "/", "-", "^", "min", "max", NULL };
-enum { ADD, MUL, DIV, SUB, POW, MIN, MAX, SET };
+enum { ADD, MUL, DIV, SUB, POW, MIN, MAX, SET, POWI };
 
-#define MAX_OPS 16
+#define MAX_OPS  16
+#define MAX_POWI 64
+
+/* ops are evaluated this many samples at a time, so intermediate results
+** stay in registers rather than each op making a pass over the buffer */
+#define LANES 8
 
 typedef struct { int op, inlet; float value; } Op;
 
+typedef struct { int op, exp; const float *buf; float value; } Step;
+
 typedef struct {
   Node node;
   Op ops[MAX_OPS];
@@ -16,47 +24,106 @@ typedef struct {
 } MathNode;
 
 
-#define set(a, b) (b)
-#define add(a, b) ((a) + (b))
-#define sub(a, b) ((a) - (b))
-#define mul(a, b) ((a) * (b))
-#define div(a, b) ((a) / (b))
-
-#define op_loop(f)                                \
-  if (op.inlet >= 0) {                            \
-    float *buf = node->inlets[op.inlet].buf;      \
-    for (int i = 0; i < NODE_BUFFER_SIZE; i++) {  \
-      n->out.buf[i] = f(n->out.buf[i], buf[i]);   \
-    }                                             \
-  } else {                                        \
-    for (int i = 0; i < NODE_BUFFER_SIZE; i++) {  \
-      n->out.buf[i] = f(n->out.buf[i], op.value); \
-    }                                             \
+static inline double powi(double x, int n) {
+  /* whole-number power by repeated squaring */
+  double res = 1;
+  for (int k = abs(n); k; k >>= 1) {
+    if (k & 1) { res *= x; }
+    x *= x;
   }
+  return n < 0 ? 1.0 / res : res;
+}
 
-static void process(Node *node) {
-  MathNode *n = (MathNode*) node;
 
+static int compile(MathNode *n, Step *steps) {
+  /* resolve each op's operand for this block. Constant inlets are used like
+  ** numbers, so whole-number powers of either can be done by multiplying */
   for (int j = 0; j < n->op_count; j++) {
-    const Op op = n->ops[j];
-    switch (op.op) {
-      case SET : op_loop(set);  break;
-      case ADD : op_loop(add);  break;
-      case SUB : op_loop(sub);  break;
-      case MUL : op_loop(mul);  break;
-      case DIV : op_loop(div);  break;
-      case POW : op_loop(pow);  break;
-      case MIN : op_loop(minf); break;
-      case MAX : op_loop(maxf); break;
+    const Op *op = &n->ops[j];
+    Step *s = &steps[j];
+    *s = (Step) { .op = op->op, .value = op->value };
+    if (op->inlet >= 0) {
+      NodePort *p = &n->node.inlets[op->inlet];
+      if (p->constant) { s->value = p->buf[0]; } else { s->buf = p->buf; }
+    }
+    if (s->op == POW && !s->buf && fabs(s->value) <= MAX_POWI && s->value == floor(s->value)) {
+      s->op = POWI;
+      s->exp = s->value;
+    }
+  }
+  return n->op_count;
+}
+
+
+static void load(float *dst, const Step *s, int len) {
+  if (s->buf) {
+    memcpy(dst, s->buf, sizeof(float) * len);
+  } else {
+    for (int i = 0; i < len; i++) { dst[i] = s->value; }
+  }
+}
+
+
+#define lanes(x) for (int k = 0; k < LANES; k++) { x; }
+
+static void process(Node *node) {
+  MathNode *n = (MathNode*) node;
+  const int len = node_ctx.buffer_size;
+  Step steps[MAX_OPS];
+  int count = compile(n, steps);
+
+  /* a lone operand, or the product of two as used by VCAs and send levels,
+  ** are handled by kernels */
+  if (count == 1) {
+    load(n->out.buf, &steps[0], len);
+    return;
+  }
+  if (count == 2 && steps[1].op == MUL) {
+    load(n->out.buf, &steps[0], len);
+    if (steps[1].buf) {
+      kernel_mul(n->out.buf, steps[1].buf, len);
+    } else {
+      kernel_scale(n->out.buf, steps[1].value, len);
     }
+    return;
   }
 
-  /* send output */
-  node_process(node);
+  /* buffers are always `NODE_MAX_BUFFER_SIZE` long, so a final partial group
+  ** of lanes can safely run past `len` */
+  for (int i = 0; i < len; i += LANES) {
+    float acc[LANES], b[LANES];
+    memcpy(acc, n->out.buf + i, sizeof(acc));
+
+    for (int j = 0; j < count; j++) {
+      const Step *s = &steps[j];
+      if (s->buf) {
+        memcpy(b, s->buf + i, sizeof(b));
+      } else {
+        lanes(b[k] = s->value);
+      }
+
+      switch (s->op) {
+        case SET  : lanes(acc[k] = b[k]);                  break;
+        case ADD  : lanes(acc[k] = acc[k] + b[k]);         break;
+        case SUB  : lanes(acc[k] = acc[k] - b[k]);         break;
+        case MUL  : lanes(acc[k] = acc[k] * b[k]);         break;
+        case DIV  : lanes(acc[k] = acc[k] / b[k]);         break;
+        case POW  : lanes(acc[k] = pow(acc[k], b[k]));     break;
+        case POWI : lanes(acc[k] = powi(acc[k], s->exp));  break;
+        case MIN  : lanes(acc[k] = minf(acc[k], b[k]));    break;
+        case MAX  : lanes(acc[k] = maxf(acc[k], b[k]));    break;
+      }
+    }
+
+    memcpy(n->out.buf + i, acc, sizeof(acc));
+  }
 }
 
 
 static int push_op(MathNode *n, int op_enum, char *val, char *err) {
+  if (n->op_count == MAX_OPS) {
+    sprintf(err, "too many operations"); return -1;
+  }
   Op *op = &n->ops[n->op_count];
   op->op = op_enum;
   op->inlet = string_to_enum(n->node.info->inlets, val);
@@ -69,9 +136,7 @@ static int push_op(MathNode *n, int op_enum, char *val, char *err) {
     }
   }
 
-  if (n->op_count++ >= MAX_OPS) {
-    sprintf(err, "too many operations"); return -1;
-  }
+  n->op_count++;
   return 0;
 }
 
@@ -106,23 +171,26 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_math_node(void) {
-  MathNode *node = calloc(1, sizeof(MathNode));
-
   static const char *inlets[] = { "in", "in2", "in3", NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(MathNode) };
+
   static NodeInfo info = {
     .name = "math",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
     .free = node_free,
+    .idle = node_idle,
   };
 
+  MathNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->in, &node->out);
   node->node.vtable->receive(&node->node, "set in", NULL);
 
@@ -3,46 +3,105 @@
 static const char *mode_strings[] = { "phase", "sine", "saw", "pulse", "noise", NULL };
 enum { PHASE, SINE, SAW, PULSE, NOISE };
 
+/* one cycle of a sine; the extra entries let lookups at a phase of 1.0 read
+** past the end without wrapping */
+#define TABLE_SIZE 2048
+static float sine_table[TABLE_SIZE + 2];
+
 typedef struct {
   Node node;
   int mode;
   double autophase;
+  float last_phase;
+  uint32_t seed;
   NodePort phase, freq; /* inlets */
   NodePort out;         /* outlets */
 } OscNode;
 
 
 static void update_phase(OscNode *n) {
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    n->autophase += fabs(n->freq.buf[i]) * NODE_SAMPLETIME;
+  double step = fabs(n->freq.buf[0]) * node_ctx.sampletime;
+  for (int i = 0; i < node_ctx.buffer_size; i++) {
+    if (!n->freq.constant) { step = fabs(n->freq.buf[i]) * node_ctx.sampletime; }
+    n->autophase += step;
     if (n->autophase >= 1.0) { n->autophase -= floor(n->autophase); }
     n->phase.buf[i] = n->autophase;
   }
+  n->phase.constant = false;
+}
+
+
+static inline float polyblep(float t, float dt) {
+  /* polynomial band-limited step: the residual that smooths an upward step
+  ** of 2 at t = 0, for a phase advancing by `dt` per sample */
+  if (t < dt)     { t = t / dt;       return t + t - t * t - 1; }
+  if (t > 1 - dt) { t = (t - 1) / dt; return t * t + t + t + 1; }
+  return 0;
+}
+
+
+static inline float phase_step(float t, float *last) {
+  /* the phase may come from a link, so its rate is taken from the change
+  ** since the last sample rather than the freq inlet */
+  float dt = t - *last;
+  if (dt < 0) { dt += 1; }
+  *last = t;
+  return minf(dt, 0.5);
 }
 
 
 static void process(Node *node) {
   OscNode *n = (OscNode*) node;
+  const float *phase = n->phase.buf;
+  float *out = n->out.buf;
+  float last = n->last_phase;
 
   /* auto-update phase if we don't have links to the phase inlet */
   if (n->phase.link_count == 0) {
     update_phase(n);
   }
 
-  /* write oscillator output */
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    float phase = clampf(n->phase.buf[i], 0.0, 1.0);
-    switch (n->mode) {
-      case PHASE : n->out.buf[i] = phase;                                   break;
-      case SINE  : n->out.buf[i] = sin(phase * 3.141592 * 2);               break;
-      case SAW   : n->out.buf[i] = 1.0 - 2.0 * phase;                       break;
-      case PULSE : n->out.buf[i] = phase < 0.5 ? -1.0 : 1.0;                break;
-      case NOISE : n->out.buf[i] = 1.0 - 2.0 * (rand() / (float) RAND_MAX); break;
-    }
+  /* write oscillator output; each mode has its own loop */
+  switch (n->mode) {
+    case PHASE:
+      for (int i = 0; i < node_ctx.buffer_size; i++) {
+        out[i] = clampf(phase[i], 0.0, 1.0);
+      }
+      break;
+
+    case SINE:
+      for (int i = 0; i < node_ctx.buffer_size; i++) {
+        float x = clampf(phase[i], 0.0, 1.0) * TABLE_SIZE;
+        int j = x;
+        out[i] = lerpf(sine_table[j], sine_table[j + 1], x - j);
+      }
+      break;
+
+    case SAW:
+      for (int i = 0; i < node_ctx.buffer_size; i++) {
+        float t = clampf(phase[i], 0.0, 1.0);
+        float dt = phase_step(t, &last);
+        out[i] = 1.0 - 2.0 * t + polyblep(t, dt);
+      }
+      break;
+
+    case PULSE:
+      for (int i = 0; i < node_ctx.buffer_size; i++) {
+        float t = clampf(phase[i], 0.0, 1.0);
+        float dt = phase_step(t, &last);
+        float t2 = t < 0.5 ? t + 0.5 : t - 0.5;
+        out[i] = (t < 0.5 ? -1.0 : 1.0) - polyblep(t, dt) + polyblep(t2, dt);
+      }
+      break;
+
+    case NOISE:
+      for (int i = 0; i < node_ctx.buffer_size; i++) {
+        out[i] = 1.0 - 2.0 * random_float(&n->seed);
+      }
+      break;
   }
 
-  /* send output */
-  node_process(node);
+  n->last_phase = clampf(phase[node_ctx.buffer_size - 1], 0.0, 1.0);
 }
 
 
@@ -63,15 +122,16 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_osc_node(void) {
-  OscNode *node = calloc(1, sizeof(OscNode));
-
   static const char *inlets[] = { "phase", "freq", NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(OscNode) };
+
   static NodeInfo info = {
     .name = "osc",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
@@ -80,9 +140,21 @@ Node* new_osc_node(void) {
     .free = node_free,
   };
 
+  /* nodes are only created on the script thread */
+  static uint32_t seed;
+  static bool table_ready;
+  if (!table_ready) {
+    for (int i = 0; i < TABLE_SIZE + 2; i++) {
+      sine_table[i] = sin(i * 3.14159265358979 * 2 / TABLE_SIZE);
+    }
+    table_ready = true;
+  }
+
+  OscNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->phase, &node->out);
   node_set(&node->node, "freq", 440.0);
   node->mode = SINE;
+  node->seed = ++seed * 2654435761u;
 
   return &node->node;
 }
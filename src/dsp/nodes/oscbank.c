@@ -0,0 +1,185 @@
+#include "../node.h"
+
+static const char *mode_strings[] = { "sine", "saw", "pulse", NULL };
+enum { SINE, SAW, PULSE };
+
+/* oscillators are processed in groups of LANES; the per-oscillator state is
+** kept in separate arrays so each group is a run of adjacent floats */
+#define LANES 8
+#define MAX_OSCS 64
+
+typedef struct {
+  Node node;
+  int mode;
+  int count;
+  float phase[MAX_OSCS] __attribute__((aligned(NODE_ALIGN)));
+  float ratio[MAX_OSCS] __attribute__((aligned(NODE_ALIGN)));
+  float amp[MAX_OSCS]   __attribute__((aligned(NODE_ALIGN)));
+  float gain[MAX_OSCS]  __attribute__((aligned(NODE_ALIGN)));
+  NodePort freq; /* inlets */
+  NodePort out;  /* outlets */
+} OscBankNode;
+
+
+static inline float wrap(float t) {
+  /* `t - floorf(t)` for t >= 0, written so it vectorizes without SSE4.1;
+  ** floats from 2^23 up have no fractional part */
+  float i = (int) minf(t, 8388608.0f);
+  return t < 8388608.0f ? t - i : 0;
+}
+
+
+static inline float sine(float t) {
+  /* parabolic approximation of sin(t * 2pi) with one refining step; unlike
+  ** a table lookup it needs no gather so it vectorizes */
+  float x = 1 - 2 * t;
+  float y = 4 * x * (1 - fabsf(x));
+  return 0.225f * (y * fabsf(y) - y) + y;
+}
+
+
+static inline float polyblep(float t, float dt) {
+  /* branchless form of osc's polyBLEP */
+  float idt = 1 / maxf(dt, 1e-9f);
+  float a = t * idt;
+  float b = (t - 1) * idt;
+  float ra = a + a - a * a - 1;
+  float rb = b * b + b + b + 1;
+  return t < dt ? ra : t > 1 - dt ? rb : 0;
+}
+
+
+/* runs every oscillator for each sample of the block, summing `expr` for
+** phase `t`; the loop over oscillators is kept free of branches so the
+** compiler can vectorize it across LANES oscillators at a time. Oscillators
+** at or above nyquist are muted rather than aliased */
+#define oscillators(expr)                                               \
+  for (int i = 0; i < node_ctx.buffer_size; i++) {                      \
+    if (!n->freq.constant) {                                            \
+      f = fabsf(n->freq.buf[i]) * node_ctx.sampletime;                  \
+    }                                                                   \
+    float sum = 0;                                                      \
+    for (int k = 0; k < count; k++) {                                   \
+      float dt = ratio[k] * f;                                          \
+      float t = phase[k] + dt;                                          \
+      t = wrap(t);                                                      \
+      phase[k] = t;                                                     \
+      float g = gain[k] * (dt < 0.5f);                                  \
+      sum += g * (expr);                                                \
+    }                                                                   \
+    n->out.buf[i] = sum;                                                \
+  }
+
+
+static void process(Node *node) {
+  OscBankNode *n = (OscBankNode*) node;
+  float *phase = n->phase;
+  const float *ratio = n->ratio;
+  const float *gain = n->gain;
+  int count = (n->count + LANES - 1) / LANES * LANES;
+  float f = fabsf(n->freq.buf[0]) * node_ctx.sampletime;
+
+  switch (n->mode) {
+    case SINE:
+      oscillators(sine(t));
+      break;
+    case SAW:
+      oscillators(1 - 2 * t + polyblep(t, dt));
+      break;
+    case PULSE:
+      oscillators((t < 0.5f ? -1 : 1) - polyblep(t, dt)
+        + polyblep(t < 0.5f ? t + 0.5f : t - 0.5f, dt));
+      break;
+  }
+}
+
+
+static bool idle(Node *node) {
+  OscBankNode *n = (OscBankNode*) node;
+  for (int i = 0; i < n->count; i++) {
+    if (n->gain[i] != 0) { return false; }
+  }
+  return true;
+}
+
+
+static void update_gains(OscBankNode *n) {
+  /* oscillators past `count` may still be processed as part of the last
+  ** group, so their gain is zeroed */
+  for (int i = 0; i < MAX_OSCS; i++) {
+    n->gain[i] = i < n->count ? n->amp[i] : 0;
+  }
+}
+
+
+static int receive(Node *node, const char *msg, char *err) {
+  OscBankNode *n = (OscBankNode*) node;
+  char buf[16];
+  int idx;
+  float ratio, amp;
+
+  if (sscanf(msg, "voice %d %f %f", &idx, &ratio, &amp) == 3) {
+    if (idx < 0 || idx >= MAX_OSCS) { sprintf(err, "bad voice index"); return -1; }
+    n->ratio[idx] = fabsf(ratio);
+    n->amp[idx] = amp;
+    update_gains(n);
+
+  } else if (sscanf(msg, "count %d", &idx) == 1) {
+    if (idx < 0 || idx > MAX_OSCS) { sprintf(err, "bad count"); return -1; }
+    n->count = idx;
+    update_gains(n);
+
+  } else if (sscanf(msg, "mode %15s", buf) == 1) {
+    int mode = string_to_enum(mode_strings, buf);
+    if (mode < 0) { sprintf(err, "bad mode '%s'", buf); return -1; }
+    n->mode = mode;
+
+  } else {
+    sprintf(err, "bad command"); return -1;
+  }
+
+  return 0;
+}
+
+
+Node* new_oscbank_node(void) {
+  static const char *inlets[] = { "freq", NULL };
+  static const char *outlets[] = { "out", NULL };
+
+  static NodePool pool = { sizeof(OscBankNode) };
+
+  static NodeInfo info = {
+    .name = "oscbank",
+    .inlets = inlets,
+    .outlets = outlets,
+    .pool = &pool,
+  };
+
+  static NodeVtable vtable = {
+    .process = process,
+    .receive = receive,
+    .free = node_free,
+    .idle = idle,
+  };
+
+  static uint32_t seed;
+
+  OscBankNode *node = node_pool_alloc(&pool);
+  node_init(&node->node, &info, &vtable, &node->freq, &node->out);
+  node_set(&node->node, "freq", 440.0);
+  node->mode = SINE;
+  node->count = 1;
+  uint32_t s = ++seed * 2654435761u;
+
+  /* start each oscillator at a different phase so detuned unison voices
+  ** don't begin in step */
+  for (int i = 0; i < MAX_OSCS; i++) {
+    float phase = random_float(&s);
+    node->phase[i] = i == 0 ? 0 : phase;
+    node->ratio[i] = 1;
+    node->amp[i] = 1;
+  }
+  update_gains(node);
+
+  return &node->node;
+}
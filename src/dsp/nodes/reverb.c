@@ -1,13 +1,19 @@
 #include "lib/freeverb/freeverb.h"
+#include "../kernel.h"
 #include "../node.h"
 
 const char *cmd_strings[] = { "roomsize", "damp", "wet", "dry", "width", NULL };
 enum { ROOMSIZE, DAMP, WET, DRY, WIDTH };
 
+/* seconds of silence after which the tail is assumed to have died away;
+** this is longer than any of freeverb's delay lines */
+#define QUIET_TIME 0.2
+
 typedef struct {
   Node node;
   fv_Context fv;
-  float buf[NODE_BUFFER_SIZE * 2];
+  int quiet; /* samples since the input or output was above `NODE_SILENCE` */
+  float buf[NODE_MAX_BUFFER_SIZE * 2] __attribute__((aligned(NODE_ALIGN)));
   NodePort inl, inr;   /* inlets */
   NodePort outl, outr; /* outlets */
 } ReverbNode;
@@ -17,22 +23,31 @@ static void process(Node *node) {
   ReverbNode *n = (ReverbNode*) node;
 
   /* copy inlets to buffer */
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    n->buf[i*2+0] = n->inl.buf[i];
-    n->buf[i*2+1] = n->inr.buf[i];
-  }
+  kernel_interleave(n->buf, n->inl.buf, n->inr.buf, node_ctx.buffer_size);
+  float peak = kernel_peak(n->buf, node_ctx.buffer_size * 2);
 
   /* process */
-  fv_process(&n->fv, n->buf, NODE_BUFFER_SIZE * 2);
+  fv_process(&n->fv, n->buf, node_ctx.buffer_size * 2);
 
   /* copy buffer to outlets */
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    n->outl.buf[i] = n->buf[i*2+0];
-    n->outr.buf[i] = n->buf[i*2+1];
+  kernel_deinterleave(n->outl.buf, n->outr.buf, n->buf, node_ctx.buffer_size);
+  peak = maxf(peak, kernel_peak(n->buf, node_ctx.buffer_size * 2));
+
+  if (peak > NODE_SILENCE) {
+    n->quiet = 0;
+  } else if (n->quiet < QUIET_TIME * node_ctx.samplerate) {
+    n->quiet += node_ctx.buffer_size;
   }
+}
 
-  /* send output */
-  node_process(node);
+
+static bool idle(Node *node) {
+  ReverbNode *n = (ReverbNode*) node;
+  if (n->quiet < QUIET_TIME * node_ctx.samplerate) { return false; }
+  fv_mute(&n->fv);
+  memset(n->outl.buf, 0, sizeof(float) * node_ctx.buffer_size);
+  memset(n->outr.buf, 0, sizeof(float) * node_ctx.buffer_size);
+  return true;
 }
 
 
@@ -60,26 +75,29 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_reverb_node(void) {
-  ReverbNode *node = calloc(1, sizeof(ReverbNode));
-
   static const char *inlets[] = { "left", "right", NULL };
   static const char *outlets[] = { "left", "right", NULL };
 
+  static NodePool pool = { sizeof(ReverbNode) };
+
   static NodeInfo info = {
     .name = "reverb",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
     .free = node_free,
+    .idle = idle,
   };
 
+  ReverbNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->inl, &node->outl);
   fv_init(&node->fv);
-  fv_set_samplerate(&node->fv, NODE_SAMPLERATE);
+  fv_set_samplerate(&node->fv, node_ctx.samplerate);
 
   return &node->node;
 }
@@ -1,3 +1,4 @@
+#include "../kernel.h"
 #include "../node.h"
 
 static const char *mode_strings[] = { "softclip", "hardclip", "foldback", "sine", "off", NULL };
@@ -12,13 +13,12 @@ typedef struct {
 
 
 #define process_loop(f)                        \
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) { \
+  for (int i = 0; i < node_ctx.buffer_size; i++) { \
     float in = n->in.buf[i] * n->gain.buf[i];  \
     n->out.buf[i] = f(in);                     \
   }
 
 #define softclip(in) (in / (1.0 + fabs(in)))
-#define hardclip(in) clampf(in, -1.0, 1.0)
 #define foldback(in) fabs(fabs(fmod(in - 1.0, 4.0)) - 2.0) - 1.0
 
 static void process(Node *node) {
@@ -26,14 +26,15 @@ static void process(Node *node) {
 
   switch (n->mode) {
     case SOFTCLIP : process_loop(softclip); break;
-    case HARDCLIP : process_loop(hardclip); break;
+    case HARDCLIP :
+      memcpy(n->out.buf, n->in.buf, sizeof(float) * node_ctx.buffer_size);
+      kernel_mul(n->out.buf, n->gain.buf, node_ctx.buffer_size);
+      kernel_clamp(n->out.buf, -1.0, 1.0, node_ctx.buffer_size);
+      break;
     case FOLDBACK : process_loop(foldback); break;
     case SINE     : process_loop(sin);      break;
-    case OFF      : memcpy(n->out.buf, n->in.buf, sizeof(n->out.buf)); break;
+    case OFF      : memcpy(n->out.buf, n->in.buf, sizeof(float) * node_ctx.buffer_size); break;
   }
-
-  /* send output */
-  node_process(node);
 }
 
 
@@ -54,23 +55,26 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_shaper_node(void) {
-  ShaperNode *node = calloc(1, sizeof(ShaperNode));
-
   static const char *inlets[] = { "in", "gain", NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(ShaperNode) };
+
   static NodeInfo info = {
     .name = "shaper",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
     .free = node_free,
+    .idle = node_idle,
   };
 
+  ShaperNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->in, &node->out);
   node_set(&node->node, "gain", 1.0);
 
@@ -3,50 +3,85 @@
 static const char *mode_strings[] = { "lowpass", "highpass", "bandpass", "notch", "off", NULL };
 enum { LOWPASS, HIGHPASS, BANDPASS, NOTCH, OFF };
 
+typedef struct {
+  float k, a1, a2, a3;
+} Coefs;
+
 typedef struct {
   Node node;
   int mode;
-  float d1, d2;
+  float ic1, ic2;
   NodePort in, freq, q; /* inlets */
   NodePort out;         /* outlets */
 } SvfNode;
 
 
+static inline Coefs get_coefs(float freq, float q) {
+  /* topology-preserving transform of the state variable filter: the
+  ** integrators are solved together each sample, so it stays stable up to
+  ** nyquist without oversampling */
+  float f = minf(fabs(freq), node_ctx.samplerate * 0.49);
+  float g = tanf(3.14159265f * f * node_ctx.sampletime);
+  Coefs c;
+  c.k = 1.0 / maxf(q, 0.5);
+  c.a1 = 1.0 / (1.0 + g * (g + c.k));
+  c.a2 = g * c.a1;
+  c.a3 = g * c.a2;
+  return c;
+}
+
+
+/* runs the filter over the block, writing `expr` of the input `v0`,
+** bandpass `v1` and lowpass `v2` */
+#define filter(expr)                                              \
+  for (int i = 0; i < node_ctx.buffer_size; i++) {                \
+    if (modulated) {                                              \
+      c = get_coefs(n->freq.buf[i], n->q.buf[i]);                 \
+    }                                                             \
+    float v0 = n->in.buf[i];                                      \
+    float v3 = v0 - ic2;                                          \
+    float v1 = c.a1 * ic1 + c.a2 * v3;                            \
+    float v2 = ic2 + c.a2 * ic1 + c.a3 * v3;                      \
+    ic1 = 2 * v1 - ic1;                                           \
+    ic2 = 2 * v2 - ic2;                                           \
+    n->out.buf[i] = expr;                                         \
+  }
+
+
 static void process(Node *node) {
   SvfNode *n = (SvfNode*) node;
-  const float passes = 3;
-  
-  float max_freq = NODE_SAMPLERATE * 0.130 * passes;
-  float f1, q1, in, hp;
-  float bp = n->d1;
-  float lp = n->d2;
-
-  for (int i = 0; i < NODE_BUFFER_SIZE; i++) {
-    q1 = 1.0 / maxf(n->q.buf[i], 0.5);
-    f1 = minf(fabs(n->freq.buf[i]), max_freq) / passes;
-    f1 = 2 * 3.141592 * f1 * NODE_SAMPLETIME;
-    in = n->in.buf[i];
-
-    for (int i = 0; i < passes; i++) {
-      lp = lp + f1 * bp;
-      hp = in - lp - q1 * bp;
-      bp = f1 * hp + bp;
-    }
-
-    switch (n->mode) {
-      case LOWPASS  : n->out.buf[i] = lp;      break;
-      case HIGHPASS : n->out.buf[i] = hp;      break;
-      case BANDPASS : n->out.buf[i] = bp;      break;
-      case NOTCH    : n->out.buf[i] = hp + lp; break;
-      case OFF      : n->out.buf[i] = in;      break;
-    }
+
+  /* coefficients are only worked out per sample for modulated inlets */
+  bool modulated = !n->freq.constant || !n->q.constant;
+  Coefs c = get_coefs(n->freq.buf[0], n->q.buf[0]);
+  float ic1 = n->ic1;
+  float ic2 = n->ic2;
+
+  switch (n->mode) {
+    case LOWPASS  : filter(v2);                 break;
+    case HIGHPASS : filter(v0 - c.k * v1 - v2); break;
+    case BANDPASS : filter(v1);                 break;
+    case NOTCH    : filter(v0 - c.k * v1);      break;
+    case OFF:
+      memcpy(n->out.buf, n->in.buf, sizeof(float) * node_ctx.buffer_size);
+      break;
   }
 
-  n->d1 = bp;
-  n->d2 = lp;
+  n->ic1 = ic1;
+  n->ic2 = ic2;
+}
+
 
-  /* send output */
-  node_process(node);
+static bool idle(Node *node) {
+  /* with no input the filter's state decays; clear it once it's inaudible */
+  SvfNode *n = (SvfNode*) node;
+  if (n->mode == OFF) { return true; }
+  if (n->in.buf[0] != 0 || fabs(n->ic1) > NODE_SILENCE || fabs(n->ic2) > NODE_SILENCE) {
+    return false;
+  }
+  n->ic1 = n->ic2 = 0;
+  memset(n->out.buf, 0, sizeof(float) * node_ctx.buffer_size);
+  return true;
 }
 
 
@@ -67,23 +102,26 @@ static int receive(Node *node, const char *msg, char *err) {
 
 
 Node* new_svf_node(void) {
-  SvfNode *node = calloc(1, sizeof(SvfNode));
-
   static const char *inlets[] = { "in", "freq", "q", NULL };
   static const char *outlets[] = { "out", NULL };
 
+  static NodePool pool = { sizeof(SvfNode) };
+
   static NodeInfo info = {
     .name = "svf",
     .inlets = inlets,
     .outlets = outlets,
+    .pool = &pool,
   };
 
   static NodeVtable vtable = {
     .process = process,
     .receive = receive,
     .free = node_free,
+    .idle = idle,
   };
 
+  SvfNode *node = node_pool_alloc(&pool);
   node_init(&node->node, &info, &vtable, &node->in, &node->out);
   node_set(&node->node, "freq", 440.0);
   node_set(&node->node, "q", 1.0);
@@ -0,0 +1,164 @@
+#include "../node.h"
+
+static const char *mode_strings[] = { "lowpass", "highpass", "bandpass", "notch", "off", NULL };
+enum { LOWPASS, HIGHPASS, BANDPASS, NOTCH, OFF };
+
+typedef struct {
+  NodeLanes k, a1, a2, a3;
+} Coefs;
+
+typedef struct {
+  Node node;
+  int mode;
+  NodeLanes ic1, ic2;
+  NodeLanes x[NODE_MAX_BUFFER_SIZE];
+  NodePort in[NODE_LANES], freq[NODE_LANES], q[NODE_LANES]; /* inlets */
+  NodePort out[NODE_LANES], mix;                            /* outlets */
+} SvfBankNode;
+
+
+static inline void set_coefs(Coefs *c, int ch, float freq, float q) {
+  /* same zero-delay-feedback form as svf */
+  float f = minf(fabs(freq), node_ctx.samplerate * 0.49);
+  float g = tanf(3.14159265f * f * node_ctx.sampletime);
+  c->k[ch] = 1.0 / maxf(q, 0.5);
+  c->a1[ch] = 1.0 / (1.0 + g * (g + c->k[ch]));
+  c->a2[ch] = g * c->a1[ch];
+  c->a3[ch] = g * c->a2[ch];
+}
+
+
+/* runs all channels over the block at once, replacing each input `v0` in
+** `x` with `expr` of it, the bandpass `v1` and the lowpass `v2` */
+#define filter(expr)                                              \
+  for (int i = 0; i < len; i++) {                                 \
+    if (modulated) {                                              \
+      for (int ch = 0; ch < NODE_LANES; ch++) {                   \
+        set_coefs(&c, ch, n->freq[ch].buf[i], n->q[ch].buf[i]);   \
+      }                                                           \
+    }                                                             \
+    NodeLanes v0 = n->x[i];                                       \
+    NodeLanes v3 = v0 - ic2;                                      \
+    NodeLanes v1 = c.a1 * ic1 + c.a2 * v3;                        \
+    NodeLanes v2 = ic2 + c.a2 * ic1 + c.a3 * v3;                  \
+    ic1 = 2 * v1 - ic1;                                           \
+    ic2 = 2 * v2 - ic2;                                           \
+    n->x[i] = expr;                                               \
+  }
+
+
+static void process(Node *node) {
+  SvfBankNode *n = (SvfBankNode*) node;
+  NodeLanes ic1 = n->ic1;
+  NodeLanes ic2 = n->ic2;
+  int len = node_ctx.buffer_size;
+  Coefs c;
+
+  /* coefficients are only worked out per sample if any channel's inlets
+  ** are modulated */
+  bool modulated = false;
+  for (int ch = 0; ch < NODE_LANES; ch++) {
+    modulated |= !n->freq[ch].constant || !n->q[ch].constant;
+    set_coefs(&c, ch, n->freq[ch].buf[0], n->q[ch].buf[0]);
+  }
+
+  /* gather the inlets a channel per lane */
+  for (int ch = 0; ch < NODE_LANES; ch++) {
+    const float *in = n->in[ch].buf;
+    for (int i = 0; i < len; i++) { n->x[i][ch] = in[i]; }
+  }
+
+  switch (n->mode) {
+    case LOWPASS  : filter(v2);                 break;
+    case HIGHPASS : filter(v0 - c.k * v1 - v2); break;
+    case BANDPASS : filter(v1);                 break;
+    case NOTCH    : filter(v0 - c.k * v1);      break;
+    case OFF      :                             break;
+  }
+  n->ic1 = ic1;
+  n->ic2 = ic2;
+
+  /* scatter the channels to their outlets and sum them into the mix */
+  for (int i = 0; i < len; i++) {
+    float sum = 0;
+    for (int ch = 0; ch < NODE_LANES; ch++) {
+      n->out[ch].buf[i] = n->x[i][ch];
+      sum += n->x[i][ch];
+    }
+    n->mix.buf[i] = sum;
+  }
+}
+
+
+static bool idle(Node *node) {
+  /* as svf, once every channel has no input and an inaudible state */
+  SvfBankNode *n = (SvfBankNode*) node;
+  if (n->mode == OFF) { return true; }
+  for (int ch = 0; ch < NODE_LANES; ch++) {
+    if (n->in[ch].buf[0] != 0 || fabs(n->ic1[ch]) > NODE_SILENCE || fabs(n->ic2[ch]) > NODE_SILENCE) {
+      return false;
+    }
+  }
+  for (int ch = 0; ch < NODE_LANES; ch++) {
+    n->ic1[ch] = n->ic2[ch] = 0;
+    memset(n->out[ch].buf, 0, sizeof(float) * node_ctx.buffer_size);
+  }
+  memset(n->mix.buf, 0, sizeof(float) * node_ctx.buffer_size);
+  return true;
+}
+
+
+static int receive(Node *node, const char *msg, char *err) {
+  SvfBankNode *n = (SvfBankNode*) node;
+  char buf[16];
+
+  if (sscanf(msg, "mode %15s", buf)) {
+    int idx = string_to_enum(mode_strings, buf);
+    if (idx < 0) { sprintf(err, "bad mode '%s'", buf); return -1; }
+    n->mode = idx;
+  } else {
+    sprintf(err, "bad command"); return -1;
+  }
+
+  return 0;
+}
+
+
+Node* new_svfbank_node(void) {
+  static const char *inlets[] = {
+    "in1",   "in2",   "in3",   "in4",   "in5",   "in6",   "in7",   "in8",
+    "freq1", "freq2", "freq3", "freq4", "freq5", "freq6", "freq7", "freq8",
+    "q1",    "q2",    "q3",    "q4",    "q5",    "q6",    "q7",    "q8",
+    NULL
+  };
+  static const char *outlets[] = {
+    "out1",  "out2",  "out3",  "out4",  "out5",  "out6",  "out7",  "out8",
+    "mix",
+    NULL
+  };
+
+  static NodePool pool = { sizeof(SvfBankNode) };
+
+  static NodeInfo info = {
+    .name = "svfbank",
+    .inlets = inlets,
+    .outlets = outlets,
+    .pool = &pool,
+  };
+
+  static NodeVtable vtable = {
+    .process = process,
+    .receive = receive,
+    .free = node_free,
+    .idle = idle,
+  };
+
+  SvfBankNode *node = node_pool_alloc(&pool);
+  node_init(&node->node, &info, &vtable, node->in, node->out);
+  for (int ch = 0; ch < NODE_LANES; ch++) {
+    node_set_inlet(&node->node, NODE_LANES + ch, 440.0);
+    node_set_inlet(&node->node, NODE_LANES * 2 + ch, 1.0);
+  }
+
+  return &node->node;
+}
@@ -0,0 +1,54 @@
+#include "ring.h"
+
+
+void ring_init(Ring *r, int size) {
+  expect((size & (size - 1)) == 0);
+  memset(r, 0, sizeof(*r));
+  r->data = malloc(size);
+  r->size = size;
+  expect(r->data);
+}
+
+
+int ring_write(Ring *r, const void *data, int len) {
+  unsigned rd = SDL_AtomicGet(&r->read);
+  unsigned wr = SDL_AtomicGet(&r->write);
+  if (r->size - (wr - rd) < len) { return -1; }
+
+  /* copy data, wrapping around the end of the buffer if we have to */
+  unsigned idx = wr & (r->size - 1);
+  unsigned n = r->size - idx;
+  if (n > len) { n = len; }
+  memcpy(r->data + idx, data, n);
+  memcpy(r->data, (char*) data + n, len - n);
+
+  /* make sure the data is visible before the new write index is */
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&r->write, wr + len);
+  return 0;
+}
+
+
+int ring_read(Ring *r, void *data, int len) {
+  unsigned rd = SDL_AtomicGet(&r->read);
+  unsigned wr = SDL_AtomicGet(&r->write);
+  if (wr - rd < len) { return -1; }
+  SDL_MemoryBarrierAcquire();
+
+  unsigned idx = rd & (r->size - 1);
+  unsigned n = r->size - idx;
+  if (n > len) { n = len; }
+  memcpy(data, r->data + idx, n);
+  memcpy((char*) data + n, r->data, len - n);
+
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&r->read, rd + len);
+  return 0;
+}
+
+
+int ring_count(Ring *r) {
+  unsigned rd = SDL_AtomicGet(&r->read);
+  unsigned wr = SDL_AtomicGet(&r->write);
+  return wr - rd;
+}
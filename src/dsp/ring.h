@@ -0,0 +1,20 @@
+#ifndef RING_H
+#define RING_H
+
+#include <SDL2/SDL.h>
+#include "common.h"
+
+/* single-producer / single-consumer lock-free byte queue. Reads and writes
+** are all-or-nothing: they fail rather than transfer part of the data */
+typedef struct {
+  char *data;
+  unsigned size;
+  SDL_atomic_t read, write;
+} Ring;
+
+void ring_init(Ring *r, int size);
+int ring_write(Ring *r, const void *data, int len);
+int ring_read(Ring *r, void *data, int len);
+int ring_count(Ring *r);
+
+#endif
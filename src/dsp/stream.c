@@ -0,0 +1,105 @@
+#include <SDL2/SDL.h>
+#include "ring.h"
+#include "wav.h"
+#include "stream.h"
+
+#define RING_SIZE (1 << 21)
+
+static Ring ring;
+static WavFile wav;
+static bool raw;
+static SDL_Thread *thread;
+static SDL_atomic_t active;
+static SDL_atomic_t writing;
+static SDL_atomic_t overruns;
+
+
+static void drain(void) {
+  /* write out everything in the ring in whole frames, in batches as large
+  ** as the buffer allows */
+  static float buf[1 << 14];
+  const int frame_size = sizeof(float) * wav.channels;
+  const int max = sizeof(buf) / frame_size;
+  int n;
+  while ((n = ring_count(&ring) / frame_size) > 0) {
+    if (n > max) { n = max; }
+    ring_read(&ring, buf, n * frame_size);
+    if (raw) {
+      fwrite(buf, frame_size, n, wav.fp);
+    } else {
+      wav_write(&wav, buf, n);
+    }
+  }
+}
+
+
+static int writer_thread(void *udata) {
+  while (SDL_AtomicGet(&active)) {
+    drain();
+    SDL_Delay(20);
+  }
+  return 0;
+}
+
+
+void stream_init(void) {
+  ring_init(&ring, RING_SIZE);
+  /* the app can exit without closing the stream, make sure the data
+  ** still in the ring gets written */
+  atexit(stream_close);
+}
+
+
+int stream_open(const char *filename, int samplerate, int channels, int bits) {
+  stream_close();
+
+  const char *ext = strrchr(filename, '.');
+  raw = !ext || !string_equal_nocase(ext, ".wav");
+  if (raw) {
+    memset(&wav, 0, sizeof(wav));
+    wav.fp = fopen(filename, "wb");
+    wav.channels = channels;
+    if (!wav.fp) { return -1; }
+  } else {
+    if (wav_open(&wav, filename, samplerate, channels, bits)) { return -1; }
+  }
+
+  SDL_AtomicSet(&overruns, 0);
+  SDL_AtomicSet(&active, 1);
+  thread = SDL_CreateThread(writer_thread, "Stream Writer", NULL);
+  expect(thread);
+  return 0;
+}
+
+
+void stream_close(void) {
+  if (!SDL_AtomicGet(&active)) { return; }
+
+  /* stop the audio thread writing; it may be mid-write, in which case wait
+  ** for it to finish so the ring has a single consumer once we drain it */
+  SDL_AtomicSet(&active, 0);
+  while (SDL_AtomicGet(&writing)) { SDL_Delay(1); }
+  SDL_WaitThread(thread, NULL);
+  thread = NULL;
+
+  drain();
+  if (raw) {
+    fclose(wav.fp);
+  } else {
+    wav_close(&wav);
+  }
+}
+
+
+void stream_write(const void *buf, int len) {
+  SDL_AtomicSet(&writing, 1);
+  if (SDL_AtomicGet(&active)) {
+    if (ring_write(&ring, buf, len)) { SDL_AtomicIncRef(&overruns); }
+  }
+  SDL_AtomicSet(&writing, 0);
+}
+
+
+int stream_overruns(void) {
+  return SDL_AtomicGet(&overruns);
+}
@@ -0,0 +1,17 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+
+/* records the audio thread's output to disk. The audio thread copies into a
+** lock-free ring which a writer thread drains, so a stalled disk never
+** blocks audio; if the ring fills the block is dropped and counted.
+** Filenames ending in `.wav` are written as WAV with the given bit depth
+** (see wav.h), anything else as headerless 32bit float */
+void stream_init(void);
+int stream_open(const char *filename, int samplerate, int channels, int bits);
+void stream_close(void);
+void stream_write(const void *buf, int len);
+int stream_overruns(void);
+
+#endif
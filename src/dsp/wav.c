@@ -0,0 +1,92 @@
+#include <math.h>
+#include "wav.h"
+
+
+static void write_u16(FILE *fp, uint16_t n) {
+  fputc(n, fp); fputc(n >> 8, fp);
+}
+
+
+static void write_u32(FILE *fp, uint32_t n) {
+  write_u16(fp, n); write_u16(fp, n >> 16);
+}
+
+
+static void write_header(WavFile *wav) {
+  const int bytes = wav->bits / 8;
+  uint32_t data_size = wav->frames * wav->channels * bytes;
+
+  fwrite("RIFF", 4, 1, wav->fp);
+  write_u32(wav->fp, 36 + data_size);
+  fwrite("WAVE", 4, 1, wav->fp);
+
+  fwrite("fmt ", 4, 1, wav->fp);
+  write_u32(wav->fp, 16);
+  write_u16(wav->fp, wav->bits == 32 ? 3 : 1); /* IEEE_FLOAT or PCM */
+  write_u16(wav->fp, wav->channels);
+  write_u32(wav->fp, wav->samplerate);
+  write_u32(wav->fp, wav->samplerate * wav->channels * bytes);
+  write_u16(wav->fp, wav->channels * bytes);
+  write_u16(wav->fp, bytes * 8);
+
+  fwrite("data", 4, 1, wav->fp);
+  write_u32(wav->fp, data_size);
+}
+
+
+int wav_open(WavFile *wav, const char *filename, int samplerate, int channels, int bits) {
+  expect(bits == 16 || bits == 24 || bits == 32);
+  memset(wav, 0, sizeof(*wav));
+  wav->fp = fopen(filename, "wb");
+  if (!wav->fp) { return -1; }
+  wav->samplerate = samplerate;
+  wav->channels = channels;
+  wav->bits = bits;
+  wav->seed = 0x9e3779b9;
+  /* the header's sizes are filled in by `wav_close()` */
+  write_header(wav);
+  return 0;
+}
+
+
+static void write_int(WavFile *wav, const float *buf, int len) {
+  /* convert to integer samples with triangular dither of +/-1 lsb, a chunk
+  ** at a time so the whole batch goes out in a single `fwrite()` */
+  const int bytes = wav->bits / 8;
+  const float max = 1 << (wav->bits - 1);
+  uint8_t out[1024 * 3];
+
+  while (len > 0) {
+    int n = len < 1024 ? len : 1024;
+    uint8_t *p = out;
+    for (int i = 0; i < n; i++) {
+      float dither = random_float(&wav->seed) - random_float(&wav->seed);
+      float x = floorf(buf[i] * max + dither + 0.5f);
+      int32_t s = x < -max ? -max : x > max - 1 ? max - 1 : x;
+      for (int j = 0; j < bytes; j++) { *p++ = s >> (j * 8); }
+    }
+    fwrite(out, bytes, n, wav->fp);
+    buf += n;
+    len -= n;
+  }
+}
+
+
+void wav_write(WavFile *wav, const float *buf, int frames) {
+  if (wav->bits == 32) {
+    /* float samples are written as-is, so this assumes a little endian host */
+    fwrite(buf, sizeof(float) * wav->channels, frames, wav->fp);
+  } else {
+    write_int(wav, buf, frames * wav->channels);
+  }
+  wav->frames += frames;
+}
+
+
+void wav_close(WavFile *wav) {
+  /* rewrite the header now the data size is known */
+  fseek(wav->fp, 0, SEEK_SET);
+  write_header(wav);
+  fclose(wav->fp);
+  wav->fp = NULL;
+}
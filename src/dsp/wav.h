@@ -0,0 +1,18 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include "common.h"
+
+/* `bits` is 16 or 24 for dithered integer samples, or 32 for float */
+typedef struct {
+  FILE *fp;
+  int samplerate, channels, bits;
+  uint32_t frames;
+  uint32_t seed;
+} WavFile;
+
+int wav_open(WavFile *wav, const char *filename, int samplerate, int channels, int bits);
+void wav_write(WavFile *wav, const float *buf, int frames);
+void wav_close(WavFile *wav);
+
+#endif